@@ -0,0 +1,598 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * bch.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <blk.h>
+#include <ckp.h>
+#include <mem.h>
+#include <opc.h>
+#include <prf.h>
+#include <pst.h>
+#include <rcp.h>
+#include <sig.h>
+#include <tir.h>
+#include <tpl.h>
+#include <utl.h>
+#include <wir.h>
+#include <sched.h>
+
+#define BCN     1000000
+
+static uint64_t mtm_get(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec*1000000000UL + tp.tv_nsec;
+}
+
+/* walk the chain touching only the hot header of each block */
+static uint64_t bch_wlk(struct blk *const r)
+{
+    struct lst_head *itr;
+    struct blk *etr;
+    uint64_t s;
+
+    s = r->tsm + r->tdx;
+    lst_for_each(itr, &r->lst) {
+        etr = lst_entry(itr, struct blk, lst);
+        __builtin_prefetch(itr->next);
+        s += etr->tsm + etr->tdx;
+    }
+
+    return (s);
+}
+
+static void bch_vst(struct blk *const b, void *a)
+{
+    *(uint64_t *)a += b->tsm + b->tdx;
+}
+
+/* durable blocks per second through the async log at path */
+static int bch_pst(const char *path, uint32_t n, uint32_t gc)
+{
+    struct pst *p;
+    struct blk *b;
+    uint64_t t0, t1, tp;
+    uint32_t i, j;
+
+    b = blk_add(INIT);
+    p = pst_new(path, gc, NULL, NULL);
+
+    tp = 0;
+    t0 = mtm_get();
+    for(i = 0; i < n; ++i) {
+        b = blk_add(b);
+        /* txn_add reserves CPT commands, keep the working set small */
+        if(i % 8 == 0) {
+            txn_add(b);
+            for(j = 0; j < 4; ++j)
+                txn_addcmd(b, (fcnt_t)&bch_vst, 0, j);
+        }
+        t1 = mtm_get();
+        while(!pst_put(p, b))
+            sched_yield();
+        tp += mtm_get() - t1;
+    }
+    pst_drn(p);
+    t1 = mtm_get();
+
+    printf("pst  %u blocks gc %u: %.0f durable blk/s, %lu fsyncs, "
+           "put %.1f ns/blk\n", n, gc, n / ((t1-t0) / 1e9), p->nfs,
+           (double)tp / n);
+    pst_del(p);
+
+    return (EXIT_SUCCESS);
+}
+
+/* touch a txn slot of the executing block, so placement shows */
+static void bch_cmd(uint64_t v)
+{
+    struct blk *b;
+
+    b = blk_cur();
+    b->tta[v % bcp.tpb].nce += v;
+}
+
+/*
+ * execution rate with the chain spread over the nodes of top (see
+ * mem_ini), builder pinned per block so each block lands on its own node.
+ * run under numactl to put cpus and memory on chosen nodes.
+ */
+static int bch_num(uint32_t mod, const char *top, uint32_t n, uint32_t nt)
+{
+    struct tpl *p;
+    struct blk *b, **v;
+    uint64_t t0, t1;
+    uint32_t d, i, j, k;
+
+    d = mem_ini(mod, top);
+    p = tpl_new(nt);
+    blk_pol(p);
+
+    errno = 0;
+    v = (struct blk **)malloc(sizeof(struct blk *) * n);
+    if(!valid(v)) {
+        log_err("!valid(v)");
+        _exit(EXIT_FAILURE);
+    }
+
+    b = blk_add(INIT);
+    for(i = 0; i < n; ++i) {
+        mem_pin(i % d);
+        v[i] = b = blk_add(b);
+        for(j = 0; j < 2; ++j) {
+            txn_add(b);
+            for(k = 0; k < 256; ++k)
+                txn_addcmdk(b, (fcnt_t)&bch_cmd, (void *)(uintptr_t)(k * 7919),
+                            0, k % 64 + 1, k);
+        }
+    }
+
+    t0 = mtm_get();
+    for(k = 0; k < 20; ++k)
+        for(i = 0; i < n; ++i)
+            blk_run(v[i]);
+    t1 = mtm_get();
+
+    printf("num  %s %u nodes %u threads: %.1f ns/cmd, %lu stolen\n",
+           mod == MEM_NUM ? "numa" : "sys", d, nt,
+           (double)(t1-t0) / (20.0 * n * 512), p->stl);
+    for(i = 0; i < d; ++i)
+        printf("     node %u %lu KB\n", i, mem_use(i) >> 10);
+
+    tpl_del(p);
+    free(v);
+
+    return (EXIT_SUCCESS);
+}
+
+static uint64_t bch_sum;
+
+static void bch_nop(uint64_t v)
+{
+    bch_sum += v;
+}
+
+/*
+ * chain walk and blk_itr over n blocks with chain memory from malloc
+ * (sys), the arena in base pages (base) or the arena in huge pages (hug),
+ * with dtlb misses when perf allows.
+ */
+static int bch_hug(uint32_t mod, uint32_t n)
+{
+    struct blk *b, *r;
+    struct txn *x;
+    uint64_t t0, t1, m0, m1, s, o;
+    uint32_t i, j, k;
+    int fd;
+
+    mem_ini(mod, NULL);
+    r = b = blk_add(INIT);
+    for(i = 1; i < n; ++i) {
+        b = blk_add(b);
+        /* txn_add reserves CPT commands, keep the working set small */
+        if(i % 128 == 0) {
+            txn_add(b);
+            for(j = 0; j < 8; ++j)
+                txn_addcmd(b, (fcnt_t)&bch_nop, 0, j);
+        }
+    }
+
+    /* command tables of every txn must come from the huge page half */
+    for(i = 0, o = 0; mod != MEM_SYS && i < n; ++i) {
+        b = blk_get(i);
+        for(j = 0; j < b->tdx; ++j) {
+            x = &b->tta[j];
+            o += !mem_lwr(x->cmd) + !mem_lwr(x->gtr);
+            for(k = 0; k < x->cpt; ++k)
+                o += !mem_lwr(x->cmd[k]) + !mem_lwr(x->cmd[k][0]);
+        }
+    }
+
+    fd = prf_opn(PERF_TYPE_HW_CACHE, PRF_DTL);
+    printf("hug  %s, %s pages, dtlb counter %s\n",
+           mod == MEM_SYS ? "malloc" : "arena",
+           mem_hpg() == MHP_TLB ? "hugetlb" :
+           mem_hpg() == MHP_THP ? "transparent huge" : "base",
+           fd < 0 ? "unavailable" : "on");
+
+    s = bch_wlk(r);
+    m0 = prf_get(fd);
+    t0 = mtm_get();
+    s += bch_wlk(r);
+    t1 = mtm_get();
+    m1 = prf_get(fd);
+    printf("walk %u blocks %.2f ns/blk", n, (double)(t1-t0)/n);
+    if(fd >= 0)
+        printf(", %.3f dtlb misses/blk", (double)(m1-m0)/n);
+    printf(" (%lu)\n", s);
+
+    blk_itr(r);
+    m0 = prf_get(fd);
+    t0 = mtm_get();
+    blk_itr(r);
+    t1 = mtm_get();
+    m1 = prf_get(fd);
+    printf("itr  %u blocks %.2f ns/blk", n, (double)(t1-t0)/n);
+    if(fd >= 0)
+        printf(", %.3f dtlb misses/blk", (double)(m1-m0)/n);
+    printf(" (%lu)\n", bch_sum);
+
+    prf_cls(fd);
+    if(mod != MEM_SYS)
+        printf("txn  command tables %s the huge page half (%lu outside)\n",
+               o ? "NOT in" : "in", o);
+
+    return (o ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/* resident set in KB */
+static uint64_t bch_rss(void)
+{
+    unsigned long s, r;
+    FILE *f;
+
+    f = fopen("/proc/self/statm", "r");
+    if(f == NULL)
+        return (0);
+    if(fscanf(f, "%lu %lu", &s, &r) != 2)
+        r = 0;
+    fclose(f);
+
+    return (r * (sysconf(_SC_PAGESIZE) >> 10));
+}
+
+/*
+ * n blocks of one txn with 8 commands, frozen age blocks below the tip
+ * (age 0 keeps every block expanded), then blk_itr through an lru of
+ * lru thawed blocks and a rehash of every block against its stored root.
+ */
+static int bch_tir(uint32_t n, uint32_t age, uint32_t lru)
+{
+    uint8_t trh[BFL];
+    struct blk *b, *r;
+    struct tis s;
+    uint64_t t0, t1, m0;
+    uint32_t i, j, e;
+
+    m0 = bch_rss();
+    if(age > 0)
+        tir_ini(age, lru);
+    r = b = blk_add(INIT);
+    blk_hsh(r);
+    blk_sel(r);
+    for(i = 1; i < n; ++i) {
+        b = blk_add(b);
+        txn_add(b);
+        for(j = 0; j < 8; ++j)
+            txn_addcmd(b, (fcnt_t)&bch_nop, 0, i * 8 + j);
+        blk_hsh(b);
+        blk_sel(b);
+    }
+    printf("tir  %u blocks age %u lru %u: %lu KB resident\n", n, age, lru,
+           bch_rss() - m0);
+
+    t0 = mtm_get();
+    blk_itr(r);
+    t1 = mtm_get();
+    printf("itr  %.1f us/blk (%lu)\n", (double)(t1-t0) / n / 1000.0, bch_sum);
+
+    for(i = 0, e = 0; i < n; ++i) {
+        b = blk_get(i);
+        memcpy(trh, blk_bcd(b)->trh, BFL);
+        blk_hsh(b);
+        e += memcmp(trh, b->bcd->trh, BFL) != 0;
+    }
+    printf("hsh  %u roots differ\n", e);
+
+    if(age > 0) {
+        tir_sta(&s);
+        printf("cold %lu frozen %lu thawed, %lu thaws %lu evictions, "
+               "record %lu KB packed %lu KB (%.1fx), thaw mean %.1f max "
+               "%.1f us\n", s.nfz, s.hot, s.thw, s.evc, s.raw >> 10,
+               s.zsz >> 10, s.zsz ? (double)s.raw / s.zsz : 0,
+               s.thw ? (double)s.tns / s.thw / 1000.0 : 0, s.tmx / 1000.0);
+    }
+
+    return (e ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/* a command with receipts: gas, a log key on every fifth, a failure on every 11th */
+static void bch_rcc(uint64_t v)
+{
+    rcp_gas(v & 63);
+    if(v % 5 == 0)
+        rcp_log(v % 97);
+    if(v % 11 == 0)
+        rcp_fal(1);
+    bch_sum += v;
+}
+
+/* shape shared by bch ckp and bch rst, the tier keeps old blocks packed */
+static void bch_ckb(void)
+{
+    blk_cap(64, 16, CPS, 1);
+    opc_reg((fcnt_t)&bch_rcc);
+    tir_ini(1024, 64);
+}
+
+/* tip, its hash and the receipt totals, equal after any restart */
+static void bch_ckv(void)
+{
+    struct blk *t;
+    uint64_t *g, s;
+    uint32_t i, n;
+    uint8_t *h;
+
+    t = blk_tip();
+    n = blk_cnt();
+    errno = 0;
+    g = (uint64_t *)malloc(sizeof(uint64_t) * n);
+    if(!valid(g)) {
+        log_err("!valid(g)");
+        _exit(EXIT_FAILURE);
+    }
+    rcp_gsm(0, n, g);
+    for(i = 0, s = 0; i < n; ++i)
+        s += g[i];
+    free(g);
+
+    h = blk_bcd(t)->msh;
+    printf("tip  %u %02x%02x%02x%02x, gas %lu, %u failed txns\n", t->bnm,
+           h[0], h[1], h[2], h[3], s, rcp_fld(0, n, NULL, 0));
+}
+
+/*
+ * n blocks of 4 txns executed and appended to the block log at log, a
+ * checkpoint of the durable chain into ckp every ivl blocks unless the
+ * last one is still being written. the fork is the only pause of the
+ * producer. restart from the files with bch rst.
+ */
+static int bch_ckp(const char *log, const char *ckp, uint32_t n, uint32_t ivl)
+{
+    struct blk *b, *d;
+    struct pst *p;
+    uint64_t t0, t1, tf, ts, tm, o;
+    uint32_t i, j, k, c, f, nt;
+    pid_t w;
+    int r;
+
+    bch_ckb();
+    unlink(log);
+    unlink(ckp);
+    p = pst_new(log, 16, NULL, NULL);
+
+    b = INIT;
+    w = 0;
+    c = f = nt = 0;
+    ts = tm = 0;
+    t0 = mtm_get();
+    for(i = 0; i < n; ++i) {
+        b = blk_add(b);
+        for(j = 0; j < 4; ++j) {
+            txn_add(b);
+            for(k = 0; k < 4; ++k)
+                txn_addcmd(b, (fcnt_t)&bch_rcc, 0, i * 16UL + j * 4 + k);
+        }
+        blk_run(b);
+        blk_hsh(b);
+        blk_sel(b);
+        while(!pst_put(p, b))
+            sched_yield();
+
+        if(ivl == 0 || (i + 1) % ivl != 0)
+            continue;
+        if(w > 0) {
+            if((r = ckp_wai(w, 0)) == 0)
+                continue;
+            c += r > 0;
+            f += r < 0;
+        }
+        o = pst_pos(p, &d);
+        if(d == NULL)
+            continue;
+        tf = mtm_get();
+        w = ckp_tak(ckp, d, o);
+        tf = mtm_get() - tf;
+        ts += tf;
+        tm = tf > tm ? tf : tm;
+        nt++;
+    }
+    pst_drn(p);
+    t1 = mtm_get();
+    if(w > 0) {
+        r = ckp_wai(w, 1);
+        c += r > 0;
+        f += r < 0;
+    }
+
+    printf("ckp  %u blocks every %u: %.0f blk/s, %u checkpoints %u failed, "
+           "fork stall mean %.1f max %.1f us\n", n, ivl,
+           n / ((t1-t0) / 1e9), c, f, nt ? (double)ts / nt / 1000.0 : 0,
+           tm / 1000.0);
+    bch_ckv();
+    pst_del(p);
+
+    return (f ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void bch_rpb(struct blk *const b, void *a)
+{
+    (void)a;
+    blk_run(b);
+}
+
+/*
+ * restart from the files of bch ckp: load the checkpoint, - for none,
+ * replay the log after it, then rehash a sample of the blocks.
+ */
+static int bch_rst(const char *log, const char *ckp)
+{
+    uint8_t trh[BFL];
+    struct blk *b, *l;
+    uint64_t t0, t1, t2, m0, o;
+    uint32_t i, n, m, e;
+
+    bch_ckb();
+    m0 = bch_rss();
+    l = INIT;
+    o = 0;
+    t0 = mtm_get();
+    if(strcmp(ckp, "-") && (b = ckp_lod(ckp, &o)) != NULL)
+        l = b;
+    t1 = mtm_get();
+    m = ckp_rpl(log, &o, l, bch_rpb, NULL);
+    t2 = mtm_get();
+
+    n = blk_cnt();
+    printf("rst  %u blocks from the checkpoint in %.1f ms, %u replayed in "
+           "%.1f ms, %lu KB resident\n", n - m, (t1-t0) / 1e6, m,
+           (t2-t1) / 1e6, bch_rss() - m0);
+
+    for(i = 0, e = 0; i < n; i += n / 1000 + 1) {
+        b = blk_get(i);
+        memcpy(trh, blk_bcd(b)->trh, BFL);
+        blk_hsh(b);
+        e += memcmp(trh, b->bcd->trh, BFL) != 0;
+    }
+    printf("hsh  %u sampled roots differ\n", e);
+    bch_ckv();
+
+    return (e ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/* signature known answers, see sig_kat */
+static void bch_opa(uint64_t v)
+{
+    bch_sum += v;
+}
+
+static void bch_opb(uint64_t v)
+{
+    bch_sum -= v;
+}
+
+/*
+ * a txn signed for one opcode must not verify, nor rebuild the txn root,
+ * once only its opcode is swapped for another registered one
+ */
+static int bch_sgo(void)
+{
+    uint8_t pk[PKL], sk[SKL], sd[SDL];
+    const struct wbh *h;
+    struct wcm *c;
+    struct blk *b;
+    uint8_t *o;
+    uint32_t n;
+    int r;
+
+    opc_reg((fcnt_t)&bch_opa);
+    opc_reg((fcnt_t)&bch_opb);
+    memset(sd, 7, SDL);
+    sig_key(pk, sk, sd);
+
+    b = blk_add(INIT);
+    txn_add(b);
+    txn_addcmd(b, (fcnt_t)&bch_opa, 0, 1);
+    txn_sgn(b, sk);
+    blk_hsh(b);
+
+    n = wir_siz(b);
+    errno = 0;
+    o = (uint8_t *)aligned_alloc(WAL, WAL_UP(n));
+    if(!valid(o)) {
+        log_err("!valid(o)");
+        _exit(EXIT_FAILURE);
+    }
+    wir_enc(b, o, n);
+    h = wir_chk(o, n);
+    r = sig_blk(b, NULL) && h != NULL && wir_trc(h);
+
+    /* swap the opcode in the record and in the block */
+    c = (struct wcm *)wir_cmd(wir_txn(h, 0), 0);
+    c->opc = htole32(opc_get((fcnt_t)&bch_opb));
+    r = r && !wir_trc(h);
+    *(*(*(b->tta[0].cmd +0) +0) +0) = (void*)&bch_opb;
+    blk_hsh(b);
+    r = r && !sig_blk(b, NULL);
+    free(o);
+
+    return (r);
+}
+
+static int bch_sig(void)
+{
+    int r, s;
+
+    r = sig_kat();
+    printf("sig  known answers %s\n", r ? "pass" : "FAIL");
+    s = bch_sgo();
+    printf("sig  swapped opcode %s\n", s ? "rejected" : "ACCEPTED");
+
+    return (r && s ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i, n;
+    uint64_t t0, t1, s;
+    struct blk *b, *r;
+
+    if(argc > 1 && !strcmp(argv[1], "num"))
+        return bch_num(argc > 2 && !strcmp(argv[2], "sys") ? MEM_SYS : MEM_NUM,
+                       argc > 3 && strcmp(argv[3], "-") ? argv[3] : NULL,
+                       argc > 4 ? strtoul(argv[4], NULL, 10) : 64,
+                       argc > 5 ? strtoul(argv[5], NULL, 10) : 4);
+    if(argc > 1 && !strcmp(argv[1], "hug"))
+        return bch_hug(argc < 3 || !strcmp(argv[2], "hug") ? MEM_HUG :
+                       !strcmp(argv[2], "sys") ? MEM_SYS : MEM_NUM,
+                       argc > 3 ? strtoul(argv[3], NULL, 10) : 100000);
+    if(argc > 1 && !strcmp(argv[1], "tir"))
+        return bch_tir(argc > 2 ? strtoul(argv[2], NULL, 10) : 1000,
+                       argc > 3 ? strtoul(argv[3], NULL, 10) : 16,
+                       argc > 4 ? strtoul(argv[4], NULL, 10) : 64);
+    if(argc > 1 && !strcmp(argv[1], "sig"))
+        return bch_sig();
+    if(argc > 3 && !strcmp(argv[1], "ckp"))
+        return bch_ckp(argv[2], argv[3],
+                       argc > 4 ? strtoul(argv[4], NULL, 10) : 100000,
+                       argc > 5 ? strtoul(argv[5], NULL, 10) : 10000);
+    if(argc > 3 && !strcmp(argv[1], "rst"))
+        return bch_rst(argv[2], argv[3]);
+    if(argc > 2 && !strcmp(argv[1], "pst"))
+        return bch_pst(argv[2], argc > 3 ? strtoul(argv[3], NULL, 10) : 10000,
+                       argc > 4 ? strtoul(argv[4], NULL, 10) : 16);
+
+    n = BCN;
+    if(argc > 1)
+        n = strtoul(argv[1], NULL, 10);
+    if(n == 0)
+        n = 1;
+
+    t0 = mtm_get();
+    r = b = blk_add(INIT);
+    for(i = 1; i < n; ++i)
+        b = blk_add(b);
+    t1 = mtm_get();
+    printf("add  %u blocks %.1f ns/blk\n", n, (double)(t1-t0)/n);
+
+    /* first pass warms the tlb, second is measured */
+    s = bch_wlk(r);
+    t0 = mtm_get();
+    s += bch_wlk(r);
+    t1 = mtm_get();
+    printf("walk %u blocks %.2f ns/blk (%lu)\n", n, (double)(t1-t0)/n, s);
+
+    t0 = mtm_get();
+    s = 0;
+    blk_rng(0, n, bch_vst, &s);
+    t1 = mtm_get();
+    printf("scan %u blocks %.2f ns/blk (%lu)\n", n, (double)(t1-t0)/n, s);
+
+    return (EXIT_SUCCESS);
+}
@@ -6,10 +6,34 @@
  *
  */
 
+#include <poll.h>
+#include <pthread.h>
 #include <blk.h>
+#include <mem.h>
 #include <utl.h>
-
+#include <crx.h>
+#include <opc.h>
+#include <prf.h>
+#include <rcp.h>
+#include <sch.h>
+#include <sha.h>
+#include <tir.h>
+
+struct bcp bcp = {TPB, CPT, CPU, CPV};
 static uint32_t ctr = 0;
+static struct vec bvc = VEC_INIT;
+static struct tix btx = TIX_INIT;
+static struct tpl *pol = NULL;
+static struct crx *cxr = NULL;
+static struct blk *gen = NULL;
+static struct blk *tip = NULL;
+static uint32_t fcr = FCR_TDF;
+/* leaves of the side branches, the fork choice candidates */
+static struct blk **slf = NULL;
+static uint32_t nsl = 0;
+static uint32_t csl = 0;
+static __thread struct blk *cur = NULL;
+static pthread_mutex_t bmx = PTHREAD_MUTEX_INITIALIZER;
 
 uint64_t tsm_get(void)
 {
@@ -32,7 +56,130 @@ uint64_t tsm_get(void)
     return nsec;
 }
 
+/* fork choice: does t beat o */
+static int blk_bto(const struct blk *const t, const struct blk *const o)
+{
+    if(fcr == FCR_LEN)
+        return (t->bnm > o->bnm);
+
+    return (t->tdf > o->tdf);
+}
+
+/* fork choice: does t beat the canonical tip */
+static int blk_bet(const struct blk *const t)
+{
+    return (blk_bto(t, tip));
+}
+
+/* make b a side leaf in place of its parent */
+static void blk_lfa(struct blk *const b)
+{
+    uint32_t i;
+
+    for(i = 0; i < nsl; ++i) {
+        if(slf[i] == b->ucr) {
+            slf[i] = b;
+            return;
+        }
+    }
+    if(nsl == csl) {
+        csl = csl ? csl * 2 : 16;
+        errno = 0;
+        slf = (struct blk **)realloc(slf, sizeof(struct blk *) * csl);
+        if(!valid(slf)) {
+            log_err("!valid(slf)");
+            _exit(EXIT_FAILURE);
+        }
+    }
+    slf[nsl++] = b;
+}
+
+/* b is no longer a side leaf */
+static void blk_lfd(const struct blk *const b)
+{
+    uint32_t i;
+
+    for(i = 0; i < nsl; ++i) {
+        if(slf[i] == b) {
+            slf[i] = slf[--nsl];
+            return;
+        }
+    }
+}
+
+/* replay and free the undo journal of b, newest entry first */
+static void blk_und(struct blk *const b)
+{
+    struct jnl *j, *n;
+
+    if(b->bcd == NULL)
+        return;
+
+    for(j = b->bcd->jnl; j != NULL; j = n) {
+        n = j->nxt;
+        j->fn(j->a);
+        free(j);
+    }
+    b->bcd->jnl = NULL;
+}
+
+/*
+ * make t the canonical tip. only the segments above the fork point are
+ * touched, so the cost is the depth of the reorg, not the chain length.
+ */
+static void blk_org(struct blk *const t)
+{
+    struct lst_head old, nwb, *itr, *nxt;
+    struct blk *f, *e;
+
+    /* collect the new branch in height order until it meets the chain */
+    INIT_LST_HEAD(&nwb);
+    for(f = t; blk_get(f->bnm) != f; f = f->ucr) {
+        if(!valid(f->ucr)) {
+            log_err("!valid(f->ucr)");
+            _exit(EXIT_FAILURE);
+        }
+        lst_add(&f->lst, &nwb);
+    }
+
+    /* undo the old branch from the tip down and cut it out of the ring */
+    for(e = tip; e != f; e = e->ucr) {
+        blk_und(e);
+        tix_del(&btx, e->tsm, e);
+    }
+    if(tip != f) {
+        lst_cut_position(&old, &f->lst, &tip->lst);
+        lst_for_each_safe(itr, nxt, &old)
+            lst_del_init(itr);
+    }
+
+    lst_splice_tail(&nwb, &gen->lst);
+    vec_cut(&bvc, f->bnm + 1);
+    lst_for_each_entry_continue(f, &gen->lst, lst) {
+        vec_add(&bvc, f);
+        tix_add(&btx, f->tsm, f);
+    }
+
+    /* the old tip now ends a side branch */
+    blk_lfd(t);
+    if(tip != f)
+        blk_lfa(tip);
+
+    ctr = t->bnm + 1;
+    tip = t;
+}
+
+/*
+ * add a child of l. a child of the tip extends the chain, a child of any
+ * other block starts or extends a fork and becomes canonical when the
+ * fork choice rule prefers it.
+ */
 struct blk* blk_add(struct blk *const l)
+{
+    return (blk_addt(l, tsm_get()));
+}
+
+static struct blk* blk_adt(struct blk *const l, uint64_t t, uint32_t z)
 {
     struct blk *n;
 
@@ -51,40 +198,563 @@ struct blk* blk_add(struct blk *const l)
             log_err("ctr > 0 && !valid(l)");
             _exit(EXIT_FAILURE);
         }
+        if(l->bnm > UINT_MAX-2) {
+            log_err("invalid block num");
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    /* header and txns live on the node of the thread building the block */
+    n = (struct blk *)mem_alc(sizeof(struct blk));
+    n->tsm = t;
+    n->tdx = 0;
+    n->bcd = NULL;
+    n->tta = z ? (struct txn *)mem_alc(sizeof(struct txn) * bcp.tpb) : NULL;
+
+    if(ctr == 0) {
+        INIT_LST_HEAD(&n->lst);
+        n->ucr = NULL;
+        n->bnm = ctr++;
+        n->tdf = 1;
+        gen = tip = n;
+    } else if(l == tip) {
+        lst_add(&n->lst, &l->lst);
+        n->ucr = l;
+        n->bnm = ctr++;
+        n->tdf = l->tdf + 1;
+        tip = n;
+    } else {
+        INIT_LST_HEAD(&n->lst);
+        n->ucr = l;
+        n->bnm = l->bnm + 1;
+        n->tdf = l->tdf + 1;
+        blk_lfa(n);
+        if(blk_bet(n))
+            blk_org(n);
+        return (n);
+    }
+
+    vec_add(&bvc, n);
+    tix_add(&btx, n->tsm, n);
+    if(tir_act())
+        tir_age(n);
+
+    return (n);
+}
+
+/* blk_add with an explicit timestamp, for blocks built elsewhere */
+struct blk* blk_addt(struct blk *const l, uint64_t t)
+{
+    struct blk *n;
+    struct prv s;
+
+    if(!prf_act())
+        return (blk_adt(l, t, 1));
+
+    prf_beg(&s);
+    n = blk_adt(l, t, 1);
+    prf_end(PRP_ADD, &s);
+
+    return (n);
+}
+
+/*
+ * add a frozen child of l holding x txns but no txn table, the cold tier
+ * supplies its tables on first use (tir_map). for chains loaded from a
+ * checkpoint, see ckp.h.
+ */
+struct blk* blk_cld(struct blk *const l, uint64_t t, uint32_t x)
+{
+    struct blk *n;
+
+    if(x >= bcp.tpb) {
+        log_err("x is out of bounds");
+        _exit(EXIT_FAILURE);
+    }
+
+    n = blk_adt(l, t, 0);
+    n->tdx = x;
+
+    return (n);
+}
+
+/* set the difficulty of leaf block b and rerun fork choice */
+void blk_dif(struct blk *const b, uint64_t d)
+{
+    struct blk *s;
+    uint32_t i;
+
+    if(!valid(b)) {
+        log_err("!valid(b)");
+        _exit(EXIT_FAILURE);
+    }
+
+    b->tdf = (b->ucr ? b->ucr->tdf : 0) + d;
+    if(blk_get(b->bnm) != b) {
+        if(blk_bet(b))
+            blk_org(b);
+        return;
+    }
+
+    /* a lighter tip can lose to the best side leaf */
+    for(i = 0, s = NULL; i < nsl; ++i)
+        if(blk_bet(slf[i]) && (s == NULL || blk_bto(slf[i], s)))
+            s = slf[i];
+    if(s != NULL)
+        blk_org(s);
+}
+
+void blk_fcr(uint32_t r)
+{
+    fcr = r;
+}
+
+struct blk* blk_tip(void)
+{
+    return (tip);
+}
+
+/* block whose commands the calling thread is executing */
+struct blk* blk_cur(void)
+{
+    return (cur);
+}
+
+/* push an undo entry on b, safe to call from parallel commands */
+void blk_jnl(struct blk *const b, ufn_t fn, void *a)
+{
+    struct bcd *c;
+    struct jnl *j;
+
+    if(!valid(b) || fn == NULL) {
+        log_err("!valid(b) || fn == NULL");
+        _exit(EXIT_FAILURE);
+    }
+
+    c = b->bcd;
+    if(c == NULL) {
+        pthread_mutex_lock(&bmx);
+        c = blk_bcd(b);
+        pthread_mutex_unlock(&bmx);
     }
 
     errno = 0;
+    j = (struct jnl *)malloc(sizeof(struct jnl));
+    if(!valid(j)) {
+        log_err("!valid(j)");
+        _exit(EXIT_FAILURE);
+    }
+    j->fn = fn;
+    j->a = a;
+    j->nxt = __atomic_load_n(&c->jnl, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&c->jnl, &j->nxt, j, 0,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+}
+
+/* make the txns and cold data of a frozen block resident, see tir.h */
+void blk_thw(struct blk *const b)
+{
+    if(tir_act())
+        tir_use(b);
+}
 
-    n = (struct blk *)malloc(sizeof(struct blk));
-    if(!valid(n)) {
-        log_err("!valid(n)");
+/* blk_thw for a caller that reads the tables, until blk_rel */
+void blk_pin(struct blk *const b)
+{
+    if(tir_act())
+        tir_pin(b);
+}
+
+void blk_rel(struct blk *const b)
+{
+    if(tir_act())
+        tir_rel(b);
+}
+
+struct bcd* blk_bcd(struct blk *const b)
+{
+    struct bcd *c, *n;
+
+    if(!valid(b)) {
+        log_err("!valid(b)");
         _exit(EXIT_FAILURE);
     }
 
-    if(ctr == 0)
-        INIT_LST_HEAD(&n->lst);
+    if(b->tta == NULL)
+        blk_thw(b);
+
+    /* cold data is only materialized when a hash or bloom is needed */
+    c = __atomic_load_n(&b->bcd, __ATOMIC_ACQUIRE);
+    if(c == NULL) {
+        n = (struct bcd *)mem_aln(mem_own(b), sizeof(struct bcd));
+        memset(n, 0, sizeof(struct bcd));
+        if(__atomic_compare_exchange_n(&b->bcd, &c, n, 0, __ATOMIC_ACQ_REL,
+                                       __ATOMIC_ACQUIRE))
+            c = n;
+        else
+            mem_fre(n, sizeof(struct bcd));
+    }
+
+    return (c);
+}
+
+struct blk* blk_get(uint32_t n)
+{
+    if(n >= vec_len(&bvc))
+        return (NULL);
+
+    return ((struct blk *)vec_get(&bvc, n));
+}
+
+uint32_t blk_cnt(void)
+{
+    return (vec_len(&bvc));
+}
+
+/* visit blocks [f, t) by position, prefetching headers ahead of the cursor */
+void blk_rng(uint32_t f, uint32_t t, bfn_t fn, void *a)
+{
+    uint32_t i;
+
+    if(fn == NULL) {
+        log_err("fn is NULL");
+        _exit(EXIT_FAILURE);
+    }
+
+    if(t > vec_len(&bvc))
+        t = vec_len(&bvc);
+
+    for(i = f; i < t; ++i) {
+        if(i + PFD < t)
+            __builtin_prefetch(vec_get(&bvc, i + PFD));
+        fn((struct blk *)vec_get(&bvc, i), a);
+    }
+}
+
+/* blk_rng from t - 1 down to f */
+static void blk_rdn(uint32_t f, uint32_t t, bfn_t fn, void *a)
+{
+    uint32_t i;
+
+    if(t > vec_len(&bvc))
+        t = vec_len(&bvc);
+
+    for(i = t; i > f; --i) {
+        if(i - 1 >= f + PFD)
+            __builtin_prefetch(vec_get(&bvc, i - 1 - PFD));
+        fn((struct blk *)vec_get(&bvc, i - 1), a);
+    }
+}
+
+/* step coroutine command j of txn i once, see crt.h */
+int txn_crt(struct blk *const b, uint32_t i, uint32_t j, struct crt *const c)
+{
+    struct txn *x;
+    struct prv s;
+    cfn_t f;
+    int r;
+
+    cur = b;
+    rcp_set(b, i);
+    x = &b->tta[i];
+    f = (cfn_t)*(*(*(x->cmd +j) +0) +0);
+    if(!prf_act())
+        return (f(c, (uint64_t)*(*(*(x->cmd +j) +1) +0)));
+
+    prf_beg(&s);
+    r = f(c, (uint64_t)*(*(*(x->cmd +j) +1) +0));
+    prf_opc(opc_get((fcnt_t)f), &s);
+
+    return (r);
+}
+
+/* drive a coroutine command to completion, blocking on its awaits */
+static void txn_crs(struct blk *const b, uint32_t i, uint32_t j)
+{
+    struct pollfd p;
+    struct crt c;
+
+    memset(&c, 0, sizeof(c));
+    while(1) {
+        c.wt = CRW_NON;
+        if(txn_crt(b, i, j, &c) == CRT_DNE)
+            return;
+        if(c.wt == CRW_FD) {
+            p.fd = c.fd;
+            p.events = c.ev;
+            p.revents = 0;
+            while(poll(&p, 1, -1) < 0 && errno == EINTR)
+                ;
+            c.res = p.revents;
+        } else if(c.wt == CRW_JOB) {
+            c.res = c.job(c.ja);
+        }
+    }
+}
+
+/* run command j of txn i, the command is called with tsm and then arg+tsm */
+void txn_run(struct blk *const b, uint32_t i, uint32_t j)
+{
+    void (*f)(uint64_t);
+    struct txn *x;
+    struct prv s;
+    void *p;
+
+    x = &b->tta[i];
+    if(txn_knd(x, j) == CMK_CRT) {
+        txn_crs(b, i, j);
+        return;
+    }
+    cur = b;
+    rcp_set(b, i);
+    f = (void (*)(uint64_t))*(*(*(x->cmd +j) +0) +0);
+    p = (*(*(*(x->cmd +j) +1) +0));
+    if(!prf_act()) {
+        f(b->tsm);
+        f((uint64_t)p+b->tsm);
+        return;
+    }
+
+    prf_beg(&s);
+    f(b->tsm);
+    f((uint64_t)p+b->tsm);
+    prf_opc(opc_get((fcnt_t)f), &s);
+}
+
+/* executor pool for blk_itr, NULL runs commands inline in block order */
+void blk_pol(struct tpl *const p)
+{
+    pol = p;
+}
+
+/* coroutine executor for blk_itr, takes precedence over the pool */
+void blk_crx(struct crx *const x)
+{
+    cxr = x;
+}
+
+/* run etr, returns its command count for the profiler, read while pinned */
+static uint32_t blk_exi(struct blk *const etr)
+{
+    uint32_t i,j,c;
+
+    if(!valid(etr)) {
+        log_err("!valid(etr)");
+        _exit(EXIT_FAILURE);
+    }
+
+    if (etr->tdx < 0 || etr->tdx >= bcp.tpb) {
+            log_err("b->tdx is out of bounds");
+            _exit(EXIT_FAILURE);
+    }
+
+    /* nothing to run, and an empty block keeps its all zero rrh */
+    if(etr->tdx == 0)
+        return (0);
+
+    blk_pin(etr);
+    rcp_beg(etr);
+    if(cxr != NULL) {
+        crx_run(cxr, etr);
+    } else if(pol != NULL) {
+        sch_run(etr, pol);
+    } else {
+        for(i = 0; i < etr->tdx; ++i)
+            for(j = 0; j < etr->tta[i].cdx; ++j)
+                txn_run(etr, i, j);
+    }
+    rcp_fin(etr);
+    for(i = 0, c = 0; prf_act() && i < etr->tdx; ++i)
+        c += etr->tta[i].cdx;
+    blk_rel(etr);
+
+    return (c);
+}
+
+static void blk_exe(struct blk *const etr, void *a)
+{
+    struct prv s;
+    uint32_t c;
+
+    (void)a;
+    if(!prf_act()) {
+        blk_exi(etr);
+        return;
+    }
+
+    prf_beg(&s);
+    c = blk_exi(etr);
+    prf_blk(etr, c, &s);
+}
+
+/* execute the commands of a single block */
+void blk_run(struct blk *const b)
+{
+    blk_exe(b, NULL);
+}
+
+/* blk_chk on the pinned tables of b */
+static int blk_chx(struct blk *const b)
+{
+    struct txn *x;
+    uint32_t i, j;
+
+    if(!valid(b->tta) || b->tdx >= bcp.tpb)
+        return (0);
+
+    for(i = 0; i < b->tdx; ++i) {
+        x = &b->tta[i];
+        if(!valid(x->cmd) || !valid(x->str) || !valid(x->gtr) ||
+           x->cdx > x->cpt)
+            return (0);
+        for(j = 0; j < x->cdx; ++j)
+            if(*(*(*(x->cmd +j) +0) +0) == NULL)
+                return (0);
+    }
+
+    return (1);
+}
+
+/* structural checks that need no other block, 1 when b is well formed */
+int blk_chk(struct blk *const b)
+{
+    int r;
+
+    if(!valid(b))
+        return (0);
+    blk_pin(b);
+    r = blk_chx(b);
+    blk_rel(b);
+
+    return (r);
+}
+
+/* hash the signed content of x, everything but the signature */
+void txn_hsh(struct txn *const x)
+{
+    struct sha s;
+    uint64_t v;
+    uint32_t j, o, k;
+
+    sha_ini(&s);
+    sha_upd(&s, &x->nce, sizeof(x->nce));
+    sha_upd(&s, &x->val, sizeof(x->val));
+    sha_upd(&s, &x->fee, sizeof(x->fee));
+    sha_upd(&s, &x->gsl, sizeof(x->gsl));
+    sha_upd(&s, &x->gsp, sizeof(x->gsp));
+    sha_upd(&s, x->ato, sizeof(x->ato));
+    sha_upd(&s, x->afr, sizeof(x->afr));
+    sha_upd(&s, x->pbk, sizeof(x->pbk));
+    sha_upd(&s, &x->cdx, sizeof(x->cdx));
+    /* the opcode and kind pick what runs, they are signed with the arg */
+    for(j = 0; j < x->cdx; ++j) {
+        v = (uint64_t)*(*(*(x->cmd +j) +1) +0);
+        o = opc_get((fcnt_t)*(*(*(x->cmd +j) +0) +0));
+        k = txn_knd(x, j);
+        sha_upd(&s, &v, sizeof(v));
+        sha_upd(&s, &o, sizeof(o));
+        sha_upd(&s, &k, sizeof(k));
+    }
+    sha_upd(&s, x->str, sizeof(uint32_t) * x->cdx);
+    sha_upd(&s, x->gtr, sizeof(uint32_t) * x->cdx);
+    sha_fin(&s, x->hsh);
+}
+
+/* hash every txn of b and the txn root, independent of other blocks */
+void blk_hsh(struct blk *const b)
+{
+    struct sha s;
+    uint32_t i;
+
+    if(!valid(b)) {
+        log_err("!valid(b)");
+        _exit(EXIT_FAILURE);
+    }
+
+    blk_pin(b);
+    for(i = 0; i < b->tdx; ++i)
+        txn_hsh(&b->tta[i]);
+
+    sha_ini(&s);
+    for(i = 0; i < b->tdx; ++i)
+        sha_upd(&s, b->tta[i].hsh, BFL);
+    sha_fin(&s, blk_bcd(b)->trh);
+    blk_rel(b);
+}
+
+/* link b to its parent hash and compute its own, parent must be sealed */
+void blk_sel(struct blk *const b)
+{
+    struct bcd *c;
+    struct sha s;
+
+    if(!valid(b)) {
+        log_err("!valid(b)");
+        _exit(EXIT_FAILURE);
+    }
+
+    c = blk_bcd(b);
+    if(b->ucr != NULL)
+        memcpy(c->psh, blk_bcd(b->ucr)->msh, BFL);
     else
-        lst_add_tail(&n->lst, &l->lst);
+        memset(c->psh, 0, BFL);
+
+    sha_ini(&s);
+    sha_upd(&s, &b->bnm, sizeof(b->bnm));
+    sha_upd(&s, &b->tsm, sizeof(b->tsm));
+    sha_upd(&s, &b->tdf, sizeof(b->tdf));
+    sha_upd(&s, &b->tdx, sizeof(b->tdx));
+    sha_upd(&s, c->psh, BFL);
+    sha_upd(&s, c->trh, BFL);
+    sha_fin(&s, c->msh);
+}
 
-    n->bnm = ctr++;
-    n->tsm = tsm_get();
-    n->tdx = 0;
-    n->tta = (struct txn *)malloc(sizeof(struct txn) * TPB);
-    if(!valid(n->tta)) {
-        log_err("!valid(b->tta)");
+/* visit blocks stamped in [f, t) in timestamp order */
+uint32_t blk_tsv(uint64_t f, uint64_t t, bfn_t fn, void *a)
+{
+    uint32_t i, n;
+
+    if(fn == NULL) {
+        log_err("fn is NULL");
         _exit(EXIT_FAILURE);
     }
 
+    n = 0;
+    for(i = tix_lwb(&btx, f); i < btx.len && btx.ent[i].tsm < t; ++i, ++n) {
+        if(i + PFD < btx.len)
+            __builtin_prefetch(btx.ent[i + PFD].p);
+        fn((struct blk *)btx.ent[i].p, a);
+    }
+
     return (n);
 }
 
-void blk_itr(struct blk *const b)
+/* copy up to m blocks stamped in [f, t) to o, return the number copied */
+uint32_t blk_tse(uint64_t f, uint64_t t, struct blk **o, uint32_t m)
 {
-    struct lst_head *itr;
-    void *p;
-    struct blk *etr;
-    uint32_t i,j;
+    uint32_t i, n;
+
+    if(!valid(o) && m > 0) {
+        log_err("!valid(o)");
+        _exit(EXIT_FAILURE);
+    }
+
+    n = 0;
+    for(i = tix_lwb(&btx, f); i < btx.len && btx.ent[i].tsm < t && n < m; ++i)
+        o[n++] = (struct blk *)btx.ent[i].p;
 
+    return (n);
+}
+
+/* execute the commands of blocks stamped in [f, t) */
+uint32_t blk_tsi(uint64_t f, uint64_t t)
+{
+    return (blk_tsv(f, t, blk_exe, NULL));
+}
+
+void blk_itr(struct blk *const b)
+{
     if(!valid(b)) {
         log_err("!valid(b)");
         _exit(EXIT_FAILURE);
@@ -96,41 +766,140 @@ void blk_itr(struct blk *const b)
         _exit(EXIT_FAILURE);
         }
 
-    /* iterate over each node in list */
-    lst_for_each(itr, &b->lst) {
-        etr = lst_entry(itr, struct blk, lst);
+    /*
+     * visit every other block in the order of the original ring, newest
+     * first and wrapping from genesis to the tip: for b at height k that
+     * is k-1 .. 0, then the tip down to k+1
+     */
+    blk_rdn(0, b->bnm, blk_exe, NULL);
+    blk_rdn(b->bnm + 1, ctr, blk_exe, NULL);
+}
 
-        if(!valid(etr)) {
-            log_err("!valid(etr)");
-            _exit(EXIT_FAILURE);
-        }
+/*
+ * wire the command tables of t commands: c[i] points at the U slot
+ * pointers of command i, each slot at its V values. the common shapes
+ * are instantiated with constant bounds so the inner loop unrolls.
+ */
+#define TXN_CMW(nm, U, V)                                                   \
+static void nm(void ****c, void ***s, void **v, uint32_t t)                 \
+{                                                                           \
+    uint32_t i, j;                                                          \
+                                                                            \
+    for(i = 0; i < t; ++i, s += (U)) {                                      \
+        c[i] = s;                                                           \
+        for(j = 0; j < (U); ++j, v += (V))                                  \
+            s[j] = v;                                                       \
+    }                                                                       \
+}
 
-        if (etr->tdx < 0 || etr->tdx >= TPB) {
-                log_err("b->tdx is out of bounds");
-                _exit(EXIT_FAILURE);
-        }
+TXN_CMW(txn_cwd, CPU, CPV)
+TXN_CMW(txn_cws, CPS, 1)
+TXN_CMW(txn_cwv, bcp.cpu, bcp.cpv)
 
-        for(i = 0; i < etr->tdx; ++i) {
-            for(j = 0; j < etr->tta[i].cdx; ++j) {
-                /* execute function if array indexed function pointer is not null */
-                if((etr->tta[i].cmd +j) != NULL)
-                    ((void (*)(uint64_t))*(*(*(etr->tta[i].cmd +j)
-                        +0) +0))(etr->tsm);
-                /* execute function if array indexed function pointer is not null */
-                if((etr->tta[i].cmd +j +1) != NULL)
-                    p = (*(*(*(etr->tta[i].cmd +j) +1) +0));
-                if((etr->tta[i].cmd +j +0 +0) != NULL)
-                    ((void (*)(uint64_t))*(*(*(etr->tta[i].cmd +j)
-                        +0) +0))((uint64_t)p+etr->tsm);
-            }
-        }
+static void (*cmw)(void ****, void ***, void **, uint32_t) = txn_cwd;
+
+/* bytes of the slot pointers and values of one command */
+static size_t txn_cmz(void)
+{
+    return (((size_t)sizeof(void**) + sizeof(void*) * bcp.cpv) * bcp.cpu);
+}
+
+/*
+ * commands per table chunk. a chunk stays in a class under MSL, so it
+ * comes from the huge page half of the node arena (mem.h)
+ */
+static uint32_t txn_cpk(void)
+{
+    size_t k;
+
+    k = (MSL / 2) / txn_cmz();
+
+    return (k ? (uint32_t)k : 1);
+}
+
+/* bytes of the command pointers, gtr and str of a txn of t commands */
+static size_t txn_csz(uint32_t t)
+{
+    return (((size_t)sizeof(void***) + sizeof(uint32_t) * 2) * t);
+}
+
+/*
+ * set the capacities of the chain, before its genesis block. memory of
+ * blocks and txns follows them, shapes other than the default and the
+ * smallest (CPS slots of one value) take the generic table builder.
+ */
+void blk_cap(uint32_t tpb, uint32_t cpt, uint32_t cpu, uint32_t cpv)
+{
+    if(ctr != 0) {
+        log_err("capacities change after genesis");
+        _exit(EXIT_FAILURE);
+    }
+
+    if(tpb == 0 || tpb > TPX || cpt == 0 || cpt > CPX || cpu < CPS ||
+       cpv == 0 || (uint64_t)cpu * cpv > CPX) {
+        log_err("invalid capacities %u %u %u %u", tpb, cpt, cpu, cpv);
+        _exit(EXIT_FAILURE);
     }
+
+    bcp.tpb = tpb;
+    bcp.cpt = cpt;
+    bcp.cpu = cpu;
+    bcp.cpv = cpv;
+    if(cpu == CPU && cpv == CPV)
+        cmw = txn_cwd;
+    else if(cpu == CPS && cpv == 1)
+        cmw = txn_cws;
+    else
+        cmw = txn_cwv;
 }
 
-void txn_add(struct blk *const b)
+/*
+ * command tables of x on node d: command pointers, gtr and str in one
+ * allocation, slot pointers and values in chunks of txn_cpk commands.
+ * the values are only touched as commands land in them.
+ */
+void txn_alc(struct txn *const x, uint32_t d)
+{
+    uint8_t *p;
+    uint32_t i, k, n, t;
+
+    t = bcp.cpt;
+    k = txn_cpk();
+    p = (uint8_t *)mem_aln(d, txn_csz(t));
+    x->cpt = t;
+    x->cmd = (void****)p;
+    x->gtr = (uint32_t *)(p + sizeof(void***) * t);
+    x->str = x->gtr + t;
+    for(i = 0; i < t; i += n) {
+        n = t - i < k ? t - i : k;
+        p = (uint8_t *)mem_aln(d, txn_cmz() * n);
+        cmw(x->cmd + i, (void***)p,
+            (void**)(p + sizeof(void**) * bcp.cpu * n), n);
+    }
+}
+
+void txn_fre(struct txn *const x)
+{
+    uint32_t i, k, n;
+
+    if(x->cmd == NULL)
+        return;
+
+    /* a chunk starts at the slot pointers of its first command */
+    k = txn_cpk();
+    for(i = 0; i < x->cpt; i += n) {
+        n = x->cpt - i < k ? x->cpt - i : k;
+        mem_fre(x->cmd[i], txn_cmz() * n);
+    }
+    mem_fre(x->cmd, txn_csz(x->cpt));
+    x->cmd = NULL;
+    x->gtr = NULL;
+    x->str = NULL;
+}
+
+static void txn_adi(struct blk *const b)
 {
     struct txn *x;
-    uint32_t i,j;
 
     if(!valid(b)) {
         log_err("!valid(b)");
@@ -142,56 +911,53 @@ void txn_add(struct blk *const b)
             _exit(EXIT_FAILURE);
     }
 
-    if (b->tdx < 0 || b->tdx >= TPB) {
+    if (b->tdx < 0 || b->tdx >= bcp.tpb) {
             log_err("b->tdx is out of bounds");
             _exit(EXIT_FAILURE);
     }
 
     x = &b->tta[b->tdx];
-    x->cdx = 0;
-    errno = 0;
-    b->tta[b->tdx].cmd = (void****)malloc(sizeof(void***)*CPT);
-    if(!valid(b->tta[b->tdx].cmd)) {
-        log_err("!valid(b->tta[b->tdx].cmd)");
-        _exit(EXIT_FAILURE);
-    }
-    for(i = 0; i < CPT; ++i) {
-        errno = 0;
-        b->tta[b->tdx].cmd[i] = (void***)malloc(sizeof(void**)*CPU);
-        if(!valid(b->tta[b->tdx].cmd[i])) {
-            log_err("!valid(b->tta[b->tdx].cmd[i])");
-            _exit(EXIT_FAILURE);
-        }
-        for(j = 0; j < CPU; ++j) {
-            errno = 0;
-            b->tta[b->tdx].cmd[i][j] =
-                    (void**)malloc(sizeof(void*)*CPV);
-            if(!valid(b->tta[b->tdx].cmd[i][j])) {
-                log_err("!valid(b->tta[b->tdx].cmd[i])");
-                _exit(EXIT_FAILURE);
-            }
-        }
-    }
+    memset(x, 0, sizeof(struct txn));
+    /* commands go on the node that holds the block */
+    txn_alc(x, mem_own(b->tta));
+    b->tdx++;
+}
 
-    errno = 0;
-    b->tta[b->tdx].gtr = (uint32_t *)malloc(sizeof(uint32_t)*CPT);
-    if(!valid(b->tta[b->tdx].gtr)) {
-        log_err("!valid(b->tta[b->tdx].gtr)");
-        _exit(EXIT_FAILURE);
-    }
+void txn_add(struct blk *const b)
+{
+    struct prv s;
 
-    errno = 0;
-    b->tta[b->tdx].str = (uint32_t *)malloc(sizeof(uint32_t)*CPT);
-    if(!valid(b->tta[b->tdx].str)) {
-        log_err("!valid(b->tta->str)");
-        _exit(EXIT_FAILURE);
+    if(!prf_act()) {
+        txn_adi(b);
+        return;
     }
-    b->tdx++;
+
+    prf_beg(&s);
+    txn_adi(b);
+    prf_end(PRP_TXN, &s);
+}
+
+/* add a coroutine command, it receives t and may await, see crt.h */
+void txn_addcrt(struct blk *const b, int (*c)(struct crt *const, uint64_t),
+                uint64_t t, uint32_t k, uint32_t g)
+{
+    struct txn *x;
+
+    txn_addcmdk(b, (fcnt_t)c, NULL, t, k, g);
+    x = &b->tta[b->tdx-1];
+    *(*(*(x->cmd + x->cdx - 1) + 2) + 0) = (void*)CMK_CRT;
 }
 
 void txn_addcmd(struct blk *const b, void(*c)(void), void *d, uint64_t t)
+{
+    txn_addcmdk(b, c, d, t, SKB, 0);
+}
+
+static void txn_adc(struct blk *const b, void(*c)(void), void *d, uint64_t t,
+                    uint32_t k, uint32_t g)
 {
     struct txn *x;
+    (void)d;
     if(!valid(b)) {
         log_err("!valid(b)");
         _exit(EXIT_FAILURE);
@@ -202,7 +968,7 @@ void txn_addcmd(struct blk *const b, void(*c)(void), void *d, uint64_t t)
             _exit(EXIT_FAILURE);
     }
 
-    if (b->tdx < 0 || b->tdx >= TPB) {
+    if (b->tdx < 0 || b->tdx >= bcp.tpb) {
             log_err("b->tdx is out of bounds");
             _exit(EXIT_FAILURE);
     }
@@ -219,6 +985,30 @@ void txn_addcmd(struct blk *const b, void(*c)(void), void *d, uint64_t t)
             _exit(EXIT_FAILURE);
     }
 
+    if(x->cdx >= x->cpt) {
+        log_err("x->cdx is out of bounds");
+        _exit(EXIT_FAILURE);
+    }
+
+    x->str[x->cdx] = k;
+    x->gtr[x->cdx] = g;
+    *(*(*(x->cmd + x->cdx) + 2) + 0) = (void*)CMK_FN;
     *(*(*(x->cmd + x->cdx) + 0) + 0) = (void*)c;
     *(*(*(x->cmd + x->cdx++) + 1) + 0) = (void*)t;
 }
+
+/* add a command with state key k and group g, see sch.h */
+void txn_addcmdk(struct blk *const b, void(*c)(void), void *d, uint64_t t,
+                 uint32_t k, uint32_t g)
+{
+    struct prv s;
+
+    if(!prf_act()) {
+        txn_adc(b, c, d, t, k, g);
+        return;
+    }
+
+    prf_beg(&s);
+    txn_adc(b, c, d, t, k, g);
+    prf_end(PRP_CMD, &s);
+}
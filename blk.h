@@ -14,12 +14,37 @@
 #include <time.h>
 #include <unistd.h>
 #include <lst.h>
+#include <vec.h>
+#include <tix.h>
 
+/*
+ * default capacities: commands per txn, slots per command, values per
+ * slot, txns per block. a chain sets its own with blk_cap before the
+ * genesis block, within TPX and CPX. commands use the first CPS slots.
+ */
 #define CPT     1024
 #define CPU     7
 #define CPV     6
 #define TPB     4096
+#define CPS     3
+#define TPX     (1U << 20)
+#define CPX     (1U << 16)
 #define BFL     32
+#define CLS     64
+#define PFD     8
+
+#define FCR_TDF 0
+#define FCR_LEN 1
+
+/* capacities of this chain, see blk_cap */
+struct bcp {
+    uint32_t tpb;
+    uint32_t cpt;
+    uint32_t cpu;
+    uint32_t cpv;
+};
+
+extern struct bcp bcp;
 
 struct txn {
     void ****cmd;
@@ -37,16 +62,34 @@ struct txn {
     uint8_t ato[42];
     uint8_t afr[42];
     uint8_t hsh[BFL];
+    uint8_t pbk[BFL];
+    uint8_t sig[BFL*2];
 };
 
-struct blk {
-    uint32_t tdx;
-    uint32_t bnm;
+typedef void (*ufn_t)(void *a);
+
+/* undo journal entry, replayed newest first when a block is reorged out */
+struct jnl {
+    ufn_t fn;
+    void *a;
+    struct jnl *nxt;
+};
+
+struct rcs;
+
+/*
+ * cold block data, allocated on first access through blk_bcd(). rcs is
+ * the receipt store of the last execution, see rcp.h; pin counts users
+ * that keep the block expanded, see blk_pin. the fields from bfp on are
+ * plain data.
+ */
+struct bcd {
+    struct jnl *jnl;
+    struct rcs *rcs;
+    uint32_t pin;
     uint32_t bfp;
     uint32_t gsl;
     uint32_t gsu;
-    uint64_t tsm;
-    uint64_t dif;
     uint64_t nce;
     uint8_t msh[BFL];
     uint8_t psh[BFL];
@@ -57,17 +100,81 @@ struct blk {
     uint8_t lsb[BFL*8];
     uint8_t edt[BFL];
     uint8_t bfc[BFL];
-    struct blk *ucr;
+};
+
+/*
+ * hot block header, one cache line: everything the chain walk touches.
+ * ucr links a block to its parent, so blocks form a tree; the canonical
+ * chain is the lst ring from genesis to the tip, side blocks are unlinked.
+ * tdf is the summed difficulty from genesis, a block's own difficulty is
+ * tdf - ucr->tdf.
+ */
+struct blk {
     struct lst_head lst;
     struct txn *tta;
-};
+    struct bcd *bcd;
+    struct blk *ucr;
+    uint64_t tsm;
+    uint64_t tdf;
+    uint32_t tdx;
+    uint32_t bnm;
+} __attribute__((aligned(CLS)));
+
+static_assert(sizeof(struct blk) == CLS, "struct blk exceeds a cache line");
+
+/* command kinds, kept in cmd[j][2][0] */
+#define CMK_FN  0
+#define CMK_CRT 1
+
+static inline uint32_t txn_knd(const struct txn *const x, uint32_t j)
+{
+    return ((uint32_t)(uintptr_t)*(*(*(x->cmd +j) +2) +0));
+}
+
+struct tpl;
+struct crt;
+struct crx;
 
 typedef void (*fcnt_t)(void);
+typedef void (*bfn_t)(struct blk *const b, void *a);
 
 uint64_t tsm_get(void);
+void blk_cap(uint32_t tpb, uint32_t cpt, uint32_t cpu, uint32_t cpv);
 struct blk* blk_add(struct blk *const l);
+struct blk* blk_addt(struct blk *const l, uint64_t t);
+struct blk* blk_cld(struct blk *const l, uint64_t t, uint32_t x);
 void blk_itr(struct blk *const b);
+struct bcd* blk_bcd(struct blk *const b);
+void blk_thw(struct blk *const b);
+void blk_pin(struct blk *const b);
+void blk_rel(struct blk *const b);
+struct blk* blk_get(uint32_t n);
+uint32_t blk_cnt(void);
+void blk_rng(uint32_t f, uint32_t t, bfn_t fn, void *a);
+uint32_t blk_tsv(uint64_t f, uint64_t t, bfn_t fn, void *a);
+uint32_t blk_tse(uint64_t f, uint64_t t, struct blk **o, uint32_t m);
+uint32_t blk_tsi(uint64_t f, uint64_t t);
+void blk_pol(struct tpl *const p);
+void blk_crx(struct crx *const x);
+struct blk* blk_tip(void);
+struct blk* blk_cur(void);
+void blk_dif(struct blk *const b, uint64_t d);
+void blk_fcr(uint32_t r);
+void blk_jnl(struct blk *const b, ufn_t fn, void *a);
+void blk_run(struct blk *const b);
+int blk_chk(struct blk *const b);
+void blk_hsh(struct blk *const b);
+void txn_hsh(struct txn *const x);
+void blk_sel(struct blk *const b);
 void txn_add(struct blk *const b);
+void txn_alc(struct txn *const x, uint32_t d);
+void txn_fre(struct txn *const x);
 void txn_addcmd(struct blk *const b, void(*c)(void), void *d, uint64_t t);
+void txn_addcmdk(struct blk *const b, void(*c)(void), void *d, uint64_t t,
+                 uint32_t k, uint32_t g);
+void txn_addcrt(struct blk *const b, int (*c)(struct crt *const, uint64_t),
+                uint64_t t, uint32_t k, uint32_t g);
+void txn_run(struct blk *const b, uint32_t i, uint32_t j);
+int txn_crt(struct blk *const b, uint32_t i, uint32_t j, struct crt *const c);
 
 #endif
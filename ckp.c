@@ -0,0 +1,432 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * ckp.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <ckp.h>
+#include <tir.h>
+#include <utl.h>
+#include <wir.h>
+
+/* buffered writer of the snapshot child, bad once a write failed */
+struct ckw {
+    int fd;
+    int bad;
+    uint8_t *buf;
+    uint32_t n;
+    uint64_t off;
+};
+
+static void ckw_flu(struct ckw *const w)
+{
+    ssize_t r;
+    uint32_t o;
+
+    for(o = 0; o < w->n && !w->bad; o += r) {
+        r = write(w->fd, w->buf + o, w->n - o);
+        if(r <= 0 && errno != EINTR)
+            w->bad = 1;
+        if(r < 0)
+            r = 0;
+    }
+    w->n = 0;
+}
+
+static void ckw_put(struct ckw *const w, const void *p, uint64_t n)
+{
+    const uint8_t *s;
+    uint64_t c;
+
+    s = (const uint8_t *)p;
+    w->off += n;
+    while(n > 0) {
+        c = CKB - w->n < n ? CKB - w->n : n;
+        memcpy(w->buf + w->n, s, c);
+        w->n += c;
+        s += c;
+        n -= c;
+        if(w->n == CKB)
+            ckw_flu(w);
+    }
+}
+
+/* a column of n bytes, padded to keep the next one aligned */
+static void ckw_col(struct ckw *const w, const void *p, uint64_t n)
+{
+    static const uint8_t pad[WAL];
+
+    ckw_put(w, p, n);
+    ckw_put(w, pad, WAL_UP(n) - n);
+}
+
+static uint64_t ckp_csz(uint32_t tdx, uint32_t nlg)
+{
+    return (WAL_UP((uint64_t)sizeof(uint64_t) * nlg) +
+            WAL_UP((uint64_t)sizeof(uint32_t) * nlg) +
+            WAL_UP((uint64_t)sizeof(uint32_t) * tdx) +
+            WAL_UP((uint64_t)sizeof(uint16_t) * tdx));
+}
+
+static int ckp_pwr(int fd, const void *p, size_t n, off_t o)
+{
+    ssize_t r;
+
+    while(n > 0) {
+        r = pwrite(fd, p, n, o);
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r <= 0)
+            return (0);
+        p = (const uint8_t *)p + r;
+        n -= r;
+        o += r;
+    }
+
+    return (1);
+}
+
+/*
+ * the body of the snapshot child: blocks still frozen on a mapped record
+ * are copied as they are, the rest encoded through wir_enc, which thaws
+ * cold blocks in this process only. the file replaces path once synced.
+ */
+static int ckp_wrt(const char *path, struct blk *const t, uint64_t lof)
+{
+    char tmp[PATH_MAX];
+    const uint8_t *p;
+    struct cke *e, *x;
+    struct rcs *r;
+    struct blk *b;
+    struct ckw w;
+    struct ckh h;
+    uint8_t *q;
+    uint32_t i, n, z, qm;
+
+    if(snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+        return (0);
+
+    n = t->bnm + 1;
+    errno = 0;
+    e = (struct cke *)calloc(n, sizeof(struct cke));
+    w.buf = (uint8_t *)malloc(CKB);
+    if(!valid(e) || !valid(w.buf)) {
+        log_err("!valid(e) || !valid(w.buf)");
+        return (0);
+    }
+
+    w.fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(w.fd < 0) {
+        log_err("open()");
+        return (0);
+    }
+    w.bad = 0;
+    w.n = 0;
+    /* header and index go over this hole once every offset is known */
+    w.off = sizeof(struct ckh) + sizeof(struct cke) * (uint64_t)n;
+    if(lseek(w.fd, w.off, SEEK_SET) < 0) {
+        log_err("lseek()");
+        return (0);
+    }
+
+    q = NULL;
+    qm = 0;
+    for(i = 0; i < n && !w.bad; ++i) {
+        b = blk_get(i);
+        x = &e[i];
+        x->tsm = b->tsm;
+        x->tdf = b->tdf;
+        x->tdx = b->tdx;
+        x->wof = w.off;
+
+        p = tir_act() ? tir_wir(b, &z) : NULL;
+        if(p == NULL) {
+            z = wir_siz(b);
+            if(z > qm) {
+                free(q);
+                errno = 0;
+                q = (uint8_t *)malloc(z);
+                if(!valid(q)) {
+                    log_err("!valid(q)");
+                    return (0);
+                }
+                qm = z;
+            }
+            z = wir_enc(b, q, z);
+            p = q;
+        }
+        x->wln = z;
+        ckw_put(&w, p, z);
+
+        r = rcp_get(i);
+        if(r == NULL)
+            continue;
+        x->rof = w.off;
+        x->gas = r->gas;
+        x->nlg = r->nlg;
+        x->nfl = r->nfl;
+        memcpy(x->blm, r->blm, sizeof(x->blm));
+        ckw_col(&w, r->lgk, sizeof(uint64_t) * (uint64_t)r->nlg);
+        ckw_col(&w, r->lgt, sizeof(uint32_t) * (uint64_t)r->nlg);
+        ckw_col(&w, r->gsu, sizeof(uint32_t) * (uint64_t)r->n);
+        ckw_col(&w, r->sta, sizeof(uint16_t) * (uint64_t)r->n);
+    }
+    ckw_flu(&w);
+
+    memset(&h, 0, sizeof(h));
+    h.mag = CKM;
+    h.ver = CKV;
+    h.tpb = bcp.tpb;
+    h.cpt = bcp.cpt;
+    h.cpu = bcp.cpu;
+    h.cpv = bcp.cpv;
+    h.nbl = n;
+    h.lof = lof;
+    h.len = w.off;
+    if(w.bad || !ckp_pwr(w.fd, e, sizeof(struct cke) * (size_t)n,
+                         sizeof(struct ckh)) ||
+       !ckp_pwr(w.fd, &h, sizeof(h), 0) || fdatasync(w.fd) != 0) {
+        log_err("checkpoint write failed");
+        close(w.fd);
+        unlink(tmp);
+        return (0);
+    }
+    close(w.fd);
+
+    if(rename(tmp, path) != 0) {
+        log_err("rename()");
+        unlink(tmp);
+        return (0);
+    }
+
+    return (1);
+}
+
+/*
+ * snapshot the canonical chain from genesis to t into path, in a child
+ * process. lof is the block log offset right after t, as pst_pos reports
+ * it together with t. call it between blocks from the thread building
+ * the chain while no other thread changes it. returns the child to reap
+ * with ckp_wai, 0 when t left the canonical chain.
+ */
+pid_t ckp_tak(const char *path, struct blk *const t, uint64_t lof)
+{
+    pid_t p;
+
+    if(path == NULL || !valid(t)) {
+        log_err("path == NULL || !valid(t)");
+        _exit(EXIT_FAILURE);
+    }
+
+    if(blk_get(t->bnm) != t)
+        return (0);
+
+    errno = 0;
+    p = fork();
+    if(p < 0) {
+        log_err("fork()");
+        _exit(EXIT_FAILURE);
+    }
+    if(p == 0)
+        _exit(ckp_wrt(path, t, lof) ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    return (p);
+}
+
+/* reap snapshot p, waiting when w: 1 written, 0 still running, -1 failed */
+int ckp_wai(pid_t p, int w)
+{
+    pid_t r;
+    int s;
+
+    do {
+        r = waitpid(p, &s, w ? 0 : WNOHANG);
+    } while(r < 0 && errno == EINTR);
+
+    if(r == 0)
+        return (0);
+    if(r < 0 || !WIFEXITED(s) || WEXITSTATUS(s) != EXIT_SUCCESS)
+        return (-1);
+
+    return (1);
+}
+
+/* offsets of a mapped file of n bytes, 1 when every entry is in bounds */
+static int ckp_chk(const struct ckh *const h, const struct cke *const e,
+                   uint64_t n)
+{
+    uint64_t d;
+    uint32_t i;
+
+    d = sizeof(struct ckh) + sizeof(struct cke) * (uint64_t)h->nbl;
+    for(i = 0; i < h->nbl; ++i) {
+        if(e[i].tdx >= h->tpb || (e[i].wof & (WAL - 1)) || e[i].wof < d ||
+           e[i].wln < sizeof(struct wbh) || e[i].wof + e[i].wln > n)
+            return (0);
+        if(e[i].rof != 0 && ((e[i].rof & (WAL - 1)) || e[i].rof < d ||
+                             e[i].rof + ckp_csz(e[i].tdx, e[i].nlg) > n))
+            return (0);
+    }
+
+    return (1);
+}
+
+/*
+ * load the checkpoint at path into the empty chain and return its tip,
+ * with the log offset to replay from in lof. NULL when there is none or
+ * it is damaged, the chain is still empty then. the file stays mapped
+ * for good, the cold tier is turned on with CKA and CKL if it is off.
+ */
+struct blk* ckp_lod(const char *path, uint64_t *const lof)
+{
+    const struct cke *e;
+    const struct ckh *h;
+    struct blk *b, *l;
+    struct stat st;
+    struct rcs r;
+    uint8_t *m;
+    uint64_t o, p;
+    uint32_t i;
+    int fd;
+
+    if(path == NULL || lof == NULL) {
+        log_err("path == NULL || lof == NULL");
+        _exit(EXIT_FAILURE);
+    }
+    if(blk_cnt() != 0) {
+        log_err("checkpoint loads into a chain that is not empty");
+        _exit(EXIT_FAILURE);
+    }
+
+    errno = 0;
+    fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        if(errno != ENOENT)
+            log_wrn("cannot open checkpoint");
+        return (NULL);
+    }
+    if(fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(struct ckh)) {
+        log_wrn("checkpoint too short");
+        close(fd);
+        return (NULL);
+    }
+    m = (uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED) {
+        log_wrn("mmap()");
+        return (NULL);
+    }
+
+    h = (const struct ckh *)m;
+    e = (const struct cke *)(h + 1);
+    if(h->mag != CKM || h->ver != CKV || h->len != (uint64_t)st.st_size ||
+       h->nbl == 0 || sizeof(struct ckh) + sizeof(struct cke) *
+       (uint64_t)h->nbl > h->len || !ckp_chk(h, e, h->len)) {
+        log_wrn("damaged checkpoint");
+        munmap(m, st.st_size);
+        return (NULL);
+    }
+
+    if(h->tpb != bcp.tpb || h->cpt != bcp.cpt || h->cpu != bcp.cpu ||
+       h->cpv != bcp.cpv)
+        blk_cap(h->tpb, h->cpt, h->cpu, h->cpv);
+    if(!tir_act())
+        tir_ini(CKA, CKL);
+
+    l = INIT;
+    for(i = 0; i < h->nbl; ++i) {
+        b = blk_cld(l, e[i].tsm, e[i].tdx);
+        p = l != INIT ? l->tdf : 0;
+        if(e[i].tdf != b->tdf && e[i].tdf > p)
+            blk_dif(b, e[i].tdf - p);
+        tir_map(b, m + e[i].wof, e[i].wln);
+
+        if(e[i].rof != 0) {
+            memset(&r, 0, sizeof(r));
+            o = e[i].rof;
+            r.lgk = (uint64_t *)(m + o);
+            o += WAL_UP(sizeof(uint64_t) * (uint64_t)e[i].nlg);
+            r.lgt = (uint32_t *)(m + o);
+            o += WAL_UP(sizeof(uint32_t) * (uint64_t)e[i].nlg);
+            r.gsu = (uint32_t *)(m + o);
+            o += WAL_UP(sizeof(uint32_t) * (uint64_t)e[i].tdx);
+            r.sta = (uint16_t *)(m + o);
+            r.n = e[i].tdx;
+            r.nlg = e[i].nlg;
+            r.nfl = e[i].nfl;
+            r.gas = e[i].gas;
+            memcpy(r.blm, e[i].blm, sizeof(r.blm));
+            rcp_map(b, &r);
+        }
+        l = b;
+    }
+    *lof = h->lof;
+
+    return (l);
+}
+
+/*
+ * decode the block log at path from byte off as descendants of l, the
+ * tip, or INIT for an empty chain, calling fn on each block added. stops
+ * at the end, a torn record or one that does not extend the chain, and
+ * leaves off after the last block replayed. returns how many there were.
+ */
+uint32_t ckp_rpl(const char *path, uint64_t *const off, struct blk *l,
+                 bfn_t fn, void *a)
+{
+    const struct wbh *h;
+    struct stat st;
+    struct blk *b;
+    uint8_t *m;
+    uint64_t o, z;
+    uint32_t n;
+    int fd;
+
+    if(path == NULL || off == NULL) {
+        log_err("path == NULL || off == NULL");
+        _exit(EXIT_FAILURE);
+    }
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return (0);
+    if(fstat(fd, &st) != 0 || (uint64_t)st.st_size <= *off) {
+        if((uint64_t)st.st_size < *off)
+            log_wrn("block log ends before the checkpoint");
+        close(fd);
+        return (0);
+    }
+    z = st.st_size;
+    m = (uint8_t *)mmap(NULL, z, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED) {
+        log_err("mmap()");
+        _exit(EXIT_FAILURE);
+    }
+    madvise(m, z, MADV_SEQUENTIAL);
+
+    n = 0;
+    for(o = *off; o < z && !(o & (WAL - 1)); o += wle32(h->len)) {
+        h = wir_chk(m + o, z - o > UINT32_MAX ? UINT32_MAX : z - o);
+        if(h == NULL || wle32(h->bnm) != (l != INIT ? l->bnm + 1 : 0))
+            break;
+        b = wir_dec(h, l);
+        if(b == NULL) {
+            log_err("block %u does not decode", wle32(h->bnm));
+            _exit(EXIT_FAILURE);
+        }
+        if(fn != NULL)
+            fn(b, a);
+        l = b;
+        n++;
+    }
+    munmap(m, z);
+    *off = o;
+
+    return (n);
+}
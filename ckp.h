@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * ckp.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _CKP_H
+#define _CKP_H
+#include <stdint.h>
+#include <sys/types.h>
+#include <blk.h>
+#include <rcp.h>
+
+#define CKM     0x31504b43U
+#define CKV     1
+/* write buffer of the snapshot child */
+#define CKB     (1U << 20)
+/* cold tier age and lru when ckp_lod has to turn the tier on */
+#define CKA     64
+#define CKL     64
+
+/*
+ * restart checkpoints. ckp_tak forks, and the child writes the canonical
+ * chain up to a durable block while the parent keeps building on its
+ * copy on write pages; the fork is the only pause. the file, in host
+ * byte order, is
+ *
+ *   struct ckh                     header
+ *   struct cke[nbl]                one entry per block, genesis first
+ *   wire record, receipt columns   per block, 8 byte aligned
+ *
+ * with the columns lgk[nlg], lgt[nlg], gsu[tdx], sta[tdx], each padded
+ * to 8 bytes. ckp_lod maps the file and adds only headers: bodies stay
+ * frozen on their mapped records in the cold tier (tir_map) and receipts
+ * borrow their columns (rcp_map), so a restart does O(1) work per block
+ * behind the checkpoint. ckp_rpl then decodes the block log from lof,
+ * the offset right after the last checkpointed block.
+ */
+struct ckh {
+    uint32_t mag;
+    uint32_t ver;
+    uint32_t tpb;
+    uint32_t cpt;
+    uint32_t cpu;
+    uint32_t cpv;
+    uint32_t nbl;
+    uint32_t rsv;
+    uint64_t lof;
+    uint64_t len;
+};
+
+/* one block, rof is 0 when it has no receipts */
+struct cke {
+    uint64_t tsm;
+    uint64_t tdf;
+    uint64_t wof;
+    uint64_t rof;
+    uint64_t gas;
+    uint64_t blm[RBW];
+    uint32_t wln;
+    uint32_t tdx;
+    uint32_t nlg;
+    uint32_t nfl;
+};
+
+static_assert(sizeof(struct ckh) % 8 == 0, "ckh is not aligned");
+static_assert(sizeof(struct cke) % 8 == 0, "cke is not aligned");
+
+pid_t ckp_tak(const char *path, struct blk *const t, uint64_t lof);
+int ckp_wai(pid_t p, int w);
+struct blk* ckp_lod(const char *path, uint64_t *const lof);
+uint32_t ckp_rpl(const char *path, uint64_t *const off, struct blk *l,
+                 bfn_t fn, void *a);
+
+#endif
@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * cmp.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <cmp.h>
+#include <string.h>
+
+static inline uint32_t cmp_r32(const uint8_t *const p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return (v);
+}
+
+static inline uint32_t cmp_hsh(uint32_t v)
+{
+    return ((v * 2654435761U) >> (32 - CHB));
+}
+
+/* a length nibble overflow as runs of 255 */
+static uint8_t* cmp_len(uint8_t *o, size_t l)
+{
+    for(; l >= 255; l -= 255)
+        *o++ = 255;
+    *o++ = (uint8_t)l;
+
+    return (o);
+}
+
+static uint8_t* cmp_seq(uint8_t *o, const uint8_t *l, size_t nl, size_t f,
+                        size_t ml)
+{
+    uint8_t *t;
+
+    t = o++;
+    *t = (uint8_t)((nl < 15 ? nl : 15) << 4);
+    if(nl >= 15)
+        o = cmp_len(o, nl - 15);
+    memcpy(o, l, nl);
+    o += nl;
+    if(ml == 0)
+        return (o);
+
+    *o++ = (uint8_t)(f & 0xff);
+    *o++ = (uint8_t)(f >> 8);
+    ml -= CMN;
+    *t |= (uint8_t)(ml < 15 ? ml : 15);
+    if(ml >= 15)
+        o = cmp_len(o, ml - 15);
+
+    return (o);
+}
+
+/*
+ * compress n bytes of s into d of m bytes, returns the encoded length or
+ * 0 when m is below cmp_bnd(n). greedy single probe hash of 4 byte
+ * prefixes, long runs without a match are stepped over faster.
+ */
+size_t cmp_enc(const uint8_t *const s, size_t n, uint8_t *const d, size_t m)
+{
+    uint32_t tab[1U << CHB];
+    const uint8_t *a;
+    size_t i, r, l, e, k;
+    uint32_t h;
+    uint8_t *o;
+
+    if(m < cmp_bnd(n))
+        return (0);
+
+    o = d;
+    a = s;
+    if(n >= CML) {
+        memset(tab, 0xff, sizeof(tab));
+        e = n - CLL;
+        k = 0;
+        for(i = 0; i + CML <= n; ) {
+            h = cmp_hsh(cmp_r32(s + i));
+            r = tab[h];
+            tab[h] = (uint32_t)i;
+            if(r == UINT32_MAX || i - r > CMO ||
+               cmp_r32(s + r) != cmp_r32(s + i)) {
+                i += 1 + (k++ >> 6);
+                continue;
+            }
+
+            /* extend forward and back over literals still pending */
+            for(l = CMN; i + l < e && s[r + l] == s[i + l]; ++l)
+                ;
+            for(; i > (size_t)(a - s) && r > 0 && s[i - 1] == s[r - 1];
+                --i, --r, ++l)
+                ;
+            o = cmp_seq(o, a, s + i - a, i - r, l);
+            i += l;
+            a = s + i;
+            k = 0;
+            if(i >= 2 && i + CML <= n)
+                tab[cmp_hsh(cmp_r32(s + i - 2))] = (uint32_t)(i - 2);
+        }
+    }
+    o = cmp_seq(o, a, s + n - a, 0, 0);
+
+    return (o - d);
+}
+
+/* a length continued in 255 runs, 0 when the input ends first */
+static int cmp_get(const uint8_t **p, const uint8_t *const e, size_t *l)
+{
+    uint8_t b;
+
+    do {
+        if(*p >= e)
+            return (0);
+        b = *(*p)++;
+        *l += b;
+    } while(b == 255);
+
+    return (1);
+}
+
+/*
+ * decompress n bytes of s into d of m bytes, returns the decoded length
+ * or 0 when the input is malformed or does not fit. every length and
+ * offset is checked against both buffers.
+ */
+size_t cmp_dec(const uint8_t *const s, size_t n, uint8_t *const d, size_t m)
+{
+    const uint8_t *p, *e, *r;
+    size_t l, f;
+    uint8_t *o, *q;
+    uint8_t t;
+
+    p = s;
+    e = s + n;
+    o = d;
+    q = d + m;
+    while(p < e) {
+        t = *p++;
+        l = t >> 4;
+        if(l == 15 && !cmp_get(&p, e, &l))
+            return (0);
+        if(l > (size_t)(e - p) || l > (size_t)(q - o))
+            return (0);
+        memcpy(o, p, l);
+        o += l;
+        p += l;
+        if(p == e)
+            break;
+
+        if(e - p < 2)
+            return (0);
+        f = p[0] | (size_t)p[1] << 8;
+        p += 2;
+        l = t & 15;
+        if(l == 15 && !cmp_get(&p, e, &l))
+            return (0);
+        l += CMN;
+        if(f == 0 || f > (size_t)(o - d) || l > (size_t)(q - o))
+            return (0);
+
+        /* overlapping matches repeat the last f bytes, copy bytewise */
+        r = o - f;
+        if(f >= l) {
+            memcpy(o, r, l);
+            o += l;
+        } else {
+            while(l--)
+                *o++ = *r++;
+        }
+    }
+
+    return (o - d);
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * cmp.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _CMP_H
+#define _CMP_H
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * byte oriented lz77 codec in the lz4 block style: a sequence is a token
+ * (literal length high nibble, match length - CMN low nibble), length
+ * bytes of 255 while a nibble overflows, the literals, a 16 bit little
+ * endian match offset and more match length bytes. the last sequence
+ * has literals only. no entropy stage, decoding is a copy loop.
+ */
+#define CMN     4
+#define CHB     12
+/* the last CLL bytes are always literals, no match starts in the last CML */
+#define CLL     5
+#define CML     12
+#define CMO     65535
+
+/* worst case encoded size of n bytes */
+static inline size_t cmp_bnd(size_t n)
+{
+    return (n + n / 255 + 16);
+}
+
+size_t cmp_enc(const uint8_t *const s, size_t n, uint8_t *const d, size_t m);
+size_t cmp_dec(const uint8_t *const s, size_t n, uint8_t *const d, size_t m);
+
+#endif
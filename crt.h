@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * crt.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _CRT_H
+#define _CRT_H
+#include <stdint.h>
+
+/*
+ * stackless coroutine commands. the body is one switch on c->lin, so a
+ * command can return at an await and be re-entered right after it:
+ *
+ *   static int cmd(struct crt *const c, uint64_t t)
+ *   {
+ *       CRT_BEG(c);
+ *       CRT_FD(c, fd, EPOLLIN);        parked until fd is readable
+ *       CRT_JOB(c, rd, c->reg);        rd runs on a pool thread
+ *       CRT_CMT(c);                    parked until every earlier command
+ *       ...                            of the block has committed
+ *       CRT_END(c);
+ *   }
+ *
+ * locals do not survive an await, keep them in reg. code before CRT_CMT
+ * may run out of block order and must not touch shared state; code after
+ * it, and every command without it, commits in block order. at most one
+ * await per source line.
+ */
+enum {CRT_DNE = 0, CRT_WAI};
+
+/* what a parked coroutine waits for */
+enum {CRW_NON = 0, CRW_FD, CRW_JOB, CRW_CMT};
+
+typedef int64_t (*jfn_t)(void *a);
+
+struct crt {
+    uint32_t lin;
+    uint32_t wt;
+    int32_t fd;
+    uint32_t ev;
+    jfn_t job;
+    void *ja;
+    int64_t res;
+    uint64_t reg[4];
+};
+
+typedef int (*cfn_t)(struct crt *const c, uint64_t t);
+
+#define CRT_BEG(c)      switch((c)->lin) { case 0:
+#define CRT_YLD(c)      do { (c)->lin = __LINE__; return (CRT_WAI); \
+                             case __LINE__:; } while(0)
+#define CRT_FD(c, f, e) do { (c)->wt = CRW_FD; (c)->fd = (f); \
+                             (c)->ev = (e); CRT_YLD(c); } while(0)
+#define CRT_JOB(c, f, a) do { (c)->wt = CRW_JOB; (c)->job = (f); \
+                              (c)->ja = (a); CRT_YLD(c); } while(0)
+#define CRT_CMT(c)      do { (c)->wt = CRW_CMT; CRT_YLD(c); } while(0)
+#define CRT_END(c)      } (c)->lin = 0; (c)->wt = CRW_NON; return (CRT_DNE)
+
+#endif
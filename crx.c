@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * crx.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <sched.h>
+#include <sys/epoll.h>
+#include <crx.h>
+#include <utl.h>
+
+/* command states: plain, coroutine not started, parked, waiting to commit */
+enum {CXS_FN = 0, CXS_NEW, CXS_PRK, CXS_CMT, CXS_DNE};
+
+static void crx_fdr(struct evl *const e, void *a);
+static void crx_job(void *a);
+
+static void crx_prk(struct crx *const x, struct crc *const c)
+{
+    c->st = CXS_PRK;
+    x->sts.awt++;
+    if(++x->nfl > x->sts.mfl)
+        x->sts.mfl = x->nfl;
+}
+
+/* park c on its fd, behind any command already waiting for it */
+static void crx_wfd(struct crx *const x, struct crc *const c)
+{
+    struct crc **w, *h;
+    uint32_t n;
+    int fd;
+
+    fd = c->c.fd;
+    if(fd < 0) {
+        log_err("fd < 0");
+        _exit(EXIT_FAILURE);
+    }
+    if((uint32_t)fd >= x->nfw) {
+        for(n = x->nfw ? x->nfw : 64; n <= (uint32_t)fd; n *= 2)
+            ;
+        errno = 0;
+        w = (struct crc **)realloc(x->fdw, sizeof(struct crc *) * n);
+        if(!valid(w)) {
+            log_err("!valid(w)");
+            _exit(EXIT_FAILURE);
+        }
+        memset(w + x->nfw, 0, sizeof(struct crc *) * (n - x->nfw));
+        x->fdw = w;
+        x->nfw = n;
+    }
+
+    c->nxw = NULL;
+    h = x->fdw[fd];
+    if(h == NULL) {
+        x->fdw[fd] = c;
+        c->h.fd = fd;
+        c->wev = c->c.ev;
+        evl_wat(x->e, &c->h, c->wev);
+        return;
+    }
+    while(h->nxw != NULL)
+        h = h->nxw;
+    h->nxw = c;
+    h = x->fdw[fd];
+    if((h->wev | c->c.ev) != h->wev) {
+        h->wev |= c->c.ev;
+        evl_mod(x->e, &h->h, h->wev);
+    }
+}
+
+/* resume c until it parks, waits for its turn or finishes */
+static void crx_stp(struct crx *const x, struct crc *const c)
+{
+    while(1) {
+        c->c.wt = CRW_NON;
+        if(txn_crt(x->b, c->i, c->j, &c->c) == CRT_DNE) {
+            c->st = CXS_DNE;
+            return;
+        }
+
+        switch(c->c.wt) {
+        case CRW_FD:
+            crx_wfd(x, c);
+            crx_prk(x, c);
+            return;
+        case CRW_JOB:
+            if(x->p == NULL) {
+                c->c.res = c->c.job(c->c.ja);
+                continue;
+            }
+            crx_prk(x, c);
+            tpl_put(x->p, crx_job, c);
+            return;
+        case CRW_CMT:
+            if(c != &x->cmd[x->nxt]) {
+                c->st = CXS_CMT;
+                return;
+            }
+            continue;
+        default:
+            /* a bare yield has nothing to wait for */
+            continue;
+        }
+    }
+}
+
+/* commit in block order as far as finished commands allow */
+static void crx_adv(struct crx *const x)
+{
+    struct crc *c;
+
+    while(x->nxt < x->n) {
+        c = &x->cmd[x->nxt];
+        if(c->st == CXS_FN) {
+            txn_run(x->b, c->i, c->j);
+            c->st = CXS_DNE;
+        } else if(c->st == CXS_CMT) {
+            crx_stp(x, c);
+        }
+        if(c->st != CXS_DNE)
+            return;
+        x->nxt++;
+    }
+    evl_stp(x->e);
+}
+
+/*
+ * the fd is ready. waiters whose events fired resume in arrival order,
+ * the rest are parked again first so they keep their place in line.
+ * errors and hangups wake every waiter.
+ */
+static void crx_fdr(struct evl *const e, void *a)
+{
+    struct crc *c, *n, *r, **t;
+    struct crx *x;
+    uint32_t v;
+
+    c = (struct crc *)a;
+    x = c->x;
+    v = e->rev;
+    evl_unw(e, &c->h);
+    x->fdw[c->h.fd] = NULL;
+    for(r = NULL, t = &r; c != NULL; c = n) {
+        n = c->nxw;
+        if((c->c.ev | EPOLLERR | EPOLLHUP) & v) {
+            c->nxw = NULL;
+            *t = c;
+            t = &c->nxw;
+        } else {
+            crx_wfd(x, c);
+        }
+    }
+    for(c = r; c != NULL; c = n) {
+        n = c->nxw;
+        c->c.res = v;
+        x->nfl--;
+        crx_stp(x, c);
+    }
+    crx_adv(x);
+}
+
+/* pool side of CRT_JOB, hands the coroutine back to the loop */
+static void crx_job(void *a)
+{
+    struct crc *c;
+
+    c = (struct crc *)a;
+    c->c.res = c->c.job(c->c.ja);
+    while(!rng_put(&c->x->cq, c))
+        sched_yield();
+    evl_wak(c->x->e);
+}
+
+static void crx_wak(struct evl *const e, void *a)
+{
+    struct crc *c;
+    struct crx *x;
+
+    (void)e;
+    x = (struct crx *)a;
+    while((c = (struct crc *)rng_get(&x->cq)) != NULL) {
+        x->nfl--;
+        crx_stp(x, c);
+    }
+    crx_adv(x);
+}
+
+struct crx* crx_new(struct tpl *const p)
+{
+    struct crx *x;
+
+    errno = 0;
+    x = (struct crx *)calloc(1, sizeof(struct crx));
+    if(!valid(x)) {
+        log_err("!valid(x)");
+        _exit(EXIT_FAILURE);
+    }
+
+    x->e = evl_new(0);
+    x->p = p;
+    rng_ini(&x->cq, CXQ);
+    evl_onw(x->e, crx_wak, x);
+
+    return (x);
+}
+
+/* run every command of b, returning once the last one has committed */
+void crx_run(struct crx *const x, struct blk *const b)
+{
+    struct crc *c;
+    uint32_t i, j, k, n;
+
+    if(!valid(x) || !valid(b)) {
+        log_err("!valid(x) || !valid(b)");
+        _exit(EXIT_FAILURE);
+    }
+
+    for(i = 0, n = 0; i < b->tdx; ++i)
+        n += b->tta[i].cdx;
+    if(n == 0)
+        return;
+
+    if(n > x->cap) {
+        free(x->cmd);
+        errno = 0;
+        x->cmd = (struct crc *)malloc(sizeof(struct crc) * n);
+        if(!valid(x->cmd)) {
+            log_err("!valid(x->cmd)");
+            _exit(EXIT_FAILURE);
+        }
+        x->cap = n;
+    }
+
+    x->b = b;
+    x->n = n;
+    x->nxt = 0;
+    x->nfl = 0;
+    for(i = 0, k = 0; i < b->tdx; ++i) {
+        for(j = 0; j < b->tta[i].cdx; ++j, ++k) {
+            c = &x->cmd[k];
+            memset(&c->c, 0, sizeof(c->c));
+            c->h.fn = crx_fdr;
+            c->h.a = c;
+            c->x = x;
+            c->i = i;
+            c->j = j;
+            c->st = txn_knd(&b->tta[i], j) == CMK_CRT ? CXS_NEW : CXS_FN;
+        }
+    }
+
+    /* everything runs up to its first await before anything commits */
+    for(k = 0; k < n; ++k) {
+        if(x->cmd[k].st == CXS_NEW) {
+            x->sts.cmd++;
+            crx_stp(x, &x->cmd[k]);
+        }
+    }
+
+    x->e->stp = 0;
+    crx_adv(x);
+    if(x->nxt < x->n)
+        evl_run(x->e);
+}
+
+void crx_del(struct crx *const x)
+{
+    if(!valid(x))
+        return;
+
+    evl_del(x->e);
+    rng_fre(&x->cq);
+    free(x->cmd);
+    free(x->fdw);
+    free(x);
+}
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * crx.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _CRX_H
+#define _CRX_H
+#include <stdint.h>
+#include <blk.h>
+#include <crt.h>
+#include <evl.h>
+#include <rng.h>
+#include <tpl.h>
+
+/* jobs in flight between the pool and the loop */
+#define CXQ     4096
+
+/* a command of the running block */
+struct crc {
+    struct crt c;
+    struct evh h;
+    struct crx *x;
+    struct crc *nxw;
+    uint32_t wev;
+    uint32_t i;
+    uint32_t j;
+    uint32_t st;
+};
+
+/* commands started, awaits parked, most parked at once */
+struct crs {
+    uint64_t cmd;
+    uint64_t awt;
+    uint64_t mfl;
+};
+
+/*
+ * coroutine executor: starts every coroutine command of a block at once,
+ * parks them on their awaits in an event loop and commits commands in
+ * block order. plain commands run when the commit cursor reaches them.
+ * commands awaiting the same fd share one watch, fdw[fd] heads their
+ * chain and its wev holds the union of their events. one executor per thread; jobs run on p, or inline when p is NULL.
+ */
+struct crx {
+    struct evl *e;
+    struct tpl *p;
+    struct rng cq;
+    struct crc *cmd;
+    struct crc **fdw;
+    struct blk *b;
+    uint32_t n;
+    uint32_t cap;
+    uint32_t nxt;
+    uint32_t nfl;
+    uint32_t nfw;
+    struct crs sts;
+};
+
+struct crx* crx_new(struct tpl *const p);
+void crx_run(struct crx *const x, struct blk *const b);
+void crx_del(struct crx *const x);
+
+#endif
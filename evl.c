@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * evl.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <evl.h>
+#include <utl.h>
+
+static uint64_t evl_now(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec*1000000000UL + tp.tv_nsec;
+}
+
+static void evl_ctl(struct evl *const e, struct evh *const h, uint32_t ev,
+                    int op)
+{
+    struct epoll_event v;
+
+    v.events = ev;
+    v.data.ptr = h;
+    if(epoll_ctl(e->epf, op, h->fd, &v) != 0) {
+        log_err("epoll_ctl()");
+        _exit(EXIT_FAILURE);
+    }
+}
+
+static void evl_sst(sigset_t *const s)
+{
+    sigemptyset(s);
+    sigaddset(s, SIGINT);
+    sigaddset(s, SIGTERM);
+    sigaddset(s, SIGHUP);
+    sigaddset(s, SIGUSR1);
+}
+
+/*
+ * with EVL_SIG the signals are blocked in the calling thread, so create
+ * the loop before any thread that should inherit the mask.
+ */
+struct evl* evl_new(uint32_t f)
+{
+    struct evl *e;
+    sigset_t s;
+
+    errno = 0;
+    e = (struct evl *)calloc(1, sizeof(struct evl));
+    if(!valid(e)) {
+        log_err("!valid(e)");
+        _exit(EXIT_FAILURE);
+    }
+
+    e->sfd = -1;
+    if(f & EVL_SIG) {
+        evl_sst(&s);
+        errno = pthread_sigmask(SIG_BLOCK, &s, NULL);
+        if(errno != 0) {
+            log_err("pthread_sigmask()");
+            _exit(EXIT_FAILURE);
+        }
+        e->sfd = signalfd(-1, &s, SFD_NONBLOCK | SFD_CLOEXEC);
+    }
+
+    e->epf = epoll_create1(EPOLL_CLOEXEC);
+    e->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    e->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(e->epf < 0 || e->efd < 0 || e->tfd < 0 ||
+       ((f & EVL_SIG) && e->sfd < 0)) {
+        log_err("event fds");
+        _exit(EXIT_FAILURE);
+    }
+
+    e->tmr.fd = e->tfd;
+    e->wak.fd = e->efd;
+    e->sgn.fd = e->sfd;
+    evl_ctl(e, &e->tmr, EPOLLIN, EPOLL_CTL_ADD);
+    evl_ctl(e, &e->wak, EPOLLIN, EPOLL_CTL_ADD);
+    if(e->sfd >= 0)
+        evl_ctl(e, &e->sgn, EPOLLIN, EPOLL_CTL_ADD);
+
+    return (e);
+}
+
+/* run fn every ns, deadlines are absolute so handler time does not drift */
+void evl_tmr(struct evl *const e, uint64_t ns, efn_t fn, void *a)
+{
+    struct itimerspec t;
+
+    if(!valid(e) || ns == 0) {
+        log_err("!valid(e) || ns == 0");
+        _exit(EXIT_FAILURE);
+    }
+
+    e->tmr.fn = fn;
+    e->tmr.a = a;
+    e->ivl = ns;
+    e->nxt = evl_now() + ns;
+    t.it_value.tv_sec = e->nxt / 1000000000UL;
+    t.it_value.tv_nsec = e->nxt % 1000000000UL;
+    t.it_interval.tv_sec = ns / 1000000000UL;
+    t.it_interval.tv_nsec = ns % 1000000000UL;
+    if(timerfd_settime(e->tfd, TFD_TIMER_ABSTIME, &t, NULL) != 0) {
+        log_err("timerfd_settime()");
+        _exit(EXIT_FAILURE);
+    }
+}
+
+void evl_onw(struct evl *const e, efn_t fn, void *a)
+{
+    e->wak.fn = fn;
+    e->wak.a = a;
+}
+
+/* fn sees the signal in e->sig, SIGINT and SIGTERM also stop the loop */
+void evl_ons(struct evl *const e, efn_t fn, void *a)
+{
+    e->sgn.fn = fn;
+    e->sgn.a = a;
+}
+
+void evl_add(struct evl *const e, int fd, efn_t fn, void *a)
+{
+    if(!valid(e) || fn == NULL || e->nh == EVM) {
+        log_err("!valid(e) || fn == NULL || e->nh == EVM");
+        _exit(EXIT_FAILURE);
+    }
+
+    e->hnd[e->nh].fd = fd;
+    e->hnd[e->nh].fn = fn;
+    e->hnd[e->nh].a = a;
+    evl_ctl(e, &e->hnd[e->nh++], EPOLLIN, EPOLL_CTL_ADD);
+}
+
+/*
+ * watch h->fd for ev until evl_unw, h stays owned by the caller. an fd
+ * can be watched by one handler at a time.
+ */
+void evl_wat(struct evl *const e, struct evh *const h, uint32_t ev)
+{
+    if(!valid(e) || !valid(h) || h->fn == NULL) {
+        log_err("!valid(e) || !valid(h) || h->fn == NULL");
+        _exit(EXIT_FAILURE);
+    }
+
+    evl_ctl(e, h, ev, EPOLL_CTL_ADD);
+}
+
+/* change the events of a watched handler */
+void evl_mod(struct evl *const e, struct evh *const h, uint32_t ev)
+{
+    evl_ctl(e, h, ev, EPOLL_CTL_MOD);
+}
+
+void evl_unw(struct evl *const e, struct evh *const h)
+{
+    epoll_ctl(e->epf, EPOLL_CTL_DEL, h->fd, NULL);
+}
+
+/* safe from any thread, wakeups before the loop drains them coalesce */
+void evl_wak(struct evl *const e)
+{
+    uint64_t v;
+
+    v = 1;
+    if(write(e->efd, &v, sizeof(v)) != sizeof(v) && errno != EAGAIN)
+        log_wrn("eventfd write");
+}
+
+static void evl_tck(struct evl *const e)
+{
+    uint64_t x, d, t, j;
+
+    if(read(e->tfd, &x, sizeof(x)) != sizeof(x) || x == 0)
+        return;
+
+    /* latest deadline that fired, earlier ones in this read were missed */
+    t = evl_now();
+    d = e->nxt + (x - 1) * e->ivl;
+    e->nxt = d + e->ivl;
+    j = t > d ? t - d : 0;
+    e->jit.cnt++;
+    e->jit.mis += x - 1;
+    e->jit.jsm += j;
+    e->jit.jsq += (j / 1000) * (j / 1000);
+    if(j > e->jit.jmx)
+        e->jit.jmx = j;
+
+    if(e->tmr.fn != NULL)
+        e->tmr.fn(e, e->tmr.a);
+
+    t = evl_now() - d;
+    e->jit.lsm += t;
+    if(t > e->jit.lmx)
+        e->jit.lmx = t;
+}
+
+static void evl_sgr(struct evl *const e)
+{
+    struct signalfd_siginfo s;
+
+    while(read(e->sfd, &s, sizeof(s)) == sizeof(s)) {
+        e->sig = s.ssi_signo;
+        if(e->sgn.fn != NULL)
+            e->sgn.fn(e, e->sgn.a);
+        if(s.ssi_signo == SIGINT || s.ssi_signo == SIGTERM)
+            e->stp = 1;
+    }
+}
+
+void evl_run(struct evl *const e)
+{
+    struct epoll_event v[EVM + 3];
+    struct evh *h;
+    uint64_t x;
+    int i, n;
+
+    if(!valid(e)) {
+        log_err("!valid(e)");
+        _exit(EXIT_FAILURE);
+    }
+
+    while(!e->stp) {
+        n = epoll_wait(e->epf, v, EVM + 3, -1);
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            log_err("epoll_wait()");
+            _exit(EXIT_FAILURE);
+        }
+        for(i = 0; i < n; ++i) {
+            h = (struct evh *)v[i].data.ptr;
+            e->rev = v[i].events;
+            if(h == &e->tmr) {
+                evl_tck(e);
+            } else if(h == &e->sgn) {
+                evl_sgr(e);
+            } else if(h == &e->wak) {
+                if(read(e->efd, &x, sizeof(x)) == sizeof(x) && h->fn != NULL)
+                    h->fn(e, h->a);
+            } else {
+                h->fn(e, h->a);
+            }
+        }
+    }
+}
+
+/* from a handler on the loop thread */
+void evl_stp(struct evl *const e)
+{
+    e->stp = 1;
+}
+
+void evl_del(struct evl *const e)
+{
+    uint32_t i;
+
+    if(!valid(e))
+        return;
+
+    for(i = 0; i < e->nh; ++i)
+        epoll_ctl(e->epf, EPOLL_CTL_DEL, e->hnd[i].fd, NULL);
+    close(e->tfd);
+    close(e->efd);
+    if(e->sfd >= 0)
+        close(e->sfd);
+    close(e->epf);
+    free(e);
+}
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * evl.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _EVL_H
+#define _EVL_H
+#include <stdint.h>
+
+/* most watched descriptors besides the timer, wakeup and signal fds */
+#define EVM     64
+
+/* evl_new flags: take SIGINT, SIGTERM, SIGHUP and SIGUSR1 through a signalfd */
+#define EVL_SIG 1
+
+struct evl;
+
+typedef void (*efn_t)(struct evl *const e, void *a);
+
+struct evh {
+    int fd;
+    efn_t fn;
+    void *a;
+};
+
+/*
+ * timer statistics in ns, jsq in us^2. jitter is how late the loop saw
+ * an expiry, latency how long after the expiry its handler finished; mis
+ * counts expiries that were overrun by a slow handler.
+ */
+struct ejt {
+    uint64_t cnt;
+    uint64_t mis;
+    uint64_t jsm;
+    uint64_t jsq;
+    uint64_t jmx;
+    uint64_t lsm;
+    uint64_t lmx;
+};
+
+/*
+ * single threaded epoll loop: one periodic timerfd, one eventfd other
+ * threads poke through evl_wak, optionally one signalfd, up to EVM more
+ * fds and any number of caller owned handlers added with evl_wat.
+ * handlers run on the thread inside evl_run.
+ */
+struct evl {
+    int epf;
+    int tfd;
+    int efd;
+    int sfd;
+    uint32_t stp;
+    uint32_t sig;
+    uint32_t rev;
+    uint32_t nh;
+    uint64_t ivl;
+    uint64_t nxt;
+    struct evh tmr;
+    struct evh wak;
+    struct evh sgn;
+    struct evh hnd[EVM];
+    struct ejt jit;
+};
+
+struct evl* evl_new(uint32_t f);
+void evl_tmr(struct evl *const e, uint64_t ns, efn_t fn, void *a);
+void evl_onw(struct evl *const e, efn_t fn, void *a);
+void evl_ons(struct evl *const e, efn_t fn, void *a);
+void evl_add(struct evl *const e, int fd, efn_t fn, void *a);
+/* handlers of watched fds find the ready events in e->rev */
+void evl_wat(struct evl *const e, struct evh *const h, uint32_t ev);
+void evl_mod(struct evl *const e, struct evh *const h, uint32_t ev);
+void evl_unw(struct evl *const e, struct evh *const h);
+void evl_wak(struct evl *const e);
+void evl_run(struct evl *const e);
+void evl_stp(struct evl *const e);
+void evl_del(struct evl *const e);
+
+#endif
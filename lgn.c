@@ -0,0 +1,567 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * lgn.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <blk.h>
+#include <opc.h>
+#include <rcp.h>
+#include <rng.h>
+#include <sha.h>
+#include <tpl.h>
+#include <utl.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+/* most producer threads, default queue depth */
+#define LPM     64
+#define LQD     65536
+/* largest payload */
+#define LPL     (1U << 20)
+
+/* distribution kinds: fixed, uniform a..b, exponential with mean a */
+enum {LDF, LDU, LDE};
+
+struct ldt {
+    uint32_t knd;
+    uint64_t a;
+    uint64_t b;
+};
+
+/* a command payload, the command argument points at it */
+struct lpy {
+    uint64_t len;
+    uint8_t d[];
+};
+
+struct lcm {
+    fcnt_t fn;
+    uint64_t arg;
+};
+
+/* a generated txn, tsc is when the open loop meant to submit it */
+struct ltx {
+    uint64_t tsc;
+    uint32_t ncm;
+    struct lcm cm[];
+};
+
+struct lgn;
+
+struct lpr {
+    struct lgn *g;
+    pthread_t thr;
+    uint64_t sed;
+    double rat;
+};
+
+struct lgn {
+    struct rng q;
+    struct ldt tpb;
+    struct ldt cpt;
+    struct ldt pay;
+    uint32_t mix[OPM];
+    uint32_t nop;
+    uint32_t wsm;
+    uint32_t npr;
+    uint32_t stp;
+    uint64_t drp;
+    uint64_t gen;
+    struct lpr pr[LPM];
+};
+
+/* growable latency sample set */
+struct lsm {
+    uint64_t *v;
+    uint64_t n;
+    uint64_t m;
+};
+
+static uint64_t mtm_get(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec*1000000000UL + tp.tv_nsec;
+}
+
+static uint64_t lgn_rnd(uint64_t *const s)
+{
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return (*s * 0x2545f4914f6cdd1dULL);
+}
+
+/* "n" fixed, "a-b" uniform, "em" exponential with mean m, capped at mx */
+static void lgn_dst(struct ldt *const d, const char *s, uint64_t mx)
+{
+    char *e;
+
+    if(*s == 'e') {
+        d->knd = LDE;
+        d->a = strtoull(s + 1, NULL, 10);
+        d->b = mx;
+    } else {
+        d->a = strtoull(s, &e, 10);
+        d->b = d->a;
+        d->knd = LDF;
+        if(*e == '-') {
+            d->knd = LDU;
+            d->b = strtoull(e + 1, NULL, 10);
+        }
+    }
+    if(d->a > mx)
+        d->a = mx;
+    if(d->b > mx)
+        d->b = mx;
+    if(d->b < d->a)
+        d->b = d->a;
+}
+
+static uint64_t lgn_drw(const struct ldt *const d, uint64_t *const s)
+{
+    double u;
+    uint64_t v;
+
+    switch(d->knd) {
+    case LDU:
+        return (d->a + lgn_rnd(s) % (d->b - d->a + 1));
+    case LDE:
+        u = ((lgn_rnd(s) >> 11) + 1) * (1.0 / 9007199254740993.0);
+        v = (uint64_t)llround(-log(u) * d->a);
+        return (v > d->b ? d->b : v);
+    default:
+        return (d->a);
+    }
+}
+
+static double lgn_mea(const struct ldt *const d)
+{
+    return (d->knd == LDU ? (d->a + d->b) / 2.0 : (double)d->a);
+}
+
+/*
+ * the workload opcodes. a command is called once with the block time and
+ * once with its argument added to it, the second call finds its payload
+ * and writes the receipt: gas by payload size, a log keyed by the payload
+ * length from lgn_wst, a failed status from lgn_fal.
+ */
+static uint64_t lgn_sum;
+
+static struct lpy* lgn_arg(uint64_t v)
+{
+    struct blk *b;
+
+    b = blk_cur();
+    if(b == NULL || v == b->tsm)
+        return (NULL);
+    return ((struct lpy *)(uintptr_t)(v - b->tsm));
+}
+
+static void lgn_nop(uint64_t v)
+{
+    __atomic_add_fetch(&lgn_sum, v & 1, __ATOMIC_RELAXED);
+    rcp_gas(1);
+}
+
+/* read the payload */
+static void lgn_rdp(uint64_t v)
+{
+    struct lpy *p;
+    uint64_t i, s;
+
+    p = lgn_arg(v);
+    if(p == NULL)
+        return;
+    for(i = s = 0; i < p->len; ++i)
+        s += p->d[i];
+    __atomic_add_fetch(&lgn_sum, s, __ATOMIC_RELAXED);
+    rcp_gas(1 + p->len / 64);
+}
+
+/* hash the payload */
+static void lgn_hsp(uint64_t v)
+{
+    uint8_t h[SHL];
+    struct lpy *p;
+
+    p = lgn_arg(v);
+    if(p == NULL)
+        return;
+    sha_256(h, p->d, p->len);
+    __atomic_add_fetch(&lgn_sum, h[0], __ATOMIC_RELAXED);
+    rcp_gas(10 + p->len / 8);
+}
+
+/* write state of the executing block, keyed by the payload length */
+static void lgn_wst(uint64_t v)
+{
+    struct blk *b;
+    struct lpy *p;
+
+    p = lgn_arg(v);
+    if(p == NULL)
+        return;
+    b = blk_cur();
+    __atomic_add_fetch(&b->tta[p->len % (b->tdx ? b->tdx : 1)].nce, 1,
+                       __ATOMIC_RELAXED);
+    rcp_gas(5);
+    rcp_log(p->len);
+}
+
+/* fail the txn */
+static void lgn_fal(uint64_t v)
+{
+    if(lgn_arg(v) == NULL)
+        return;
+    rcp_gas(1);
+    rcp_fal(1);
+}
+
+static const fcnt_t lop[] = {
+    (fcnt_t)&lgn_nop,
+    (fcnt_t)&lgn_rdp,
+    (fcnt_t)&lgn_hsp,
+    (fcnt_t)&lgn_wst,
+    (fcnt_t)&lgn_fal,
+};
+
+static fcnt_t lgn_opc(struct lgn *const g, uint64_t *const s)
+{
+    uint32_t i, w;
+
+    w = lgn_rnd(s) % g->wsm;
+    for(i = 0; i < g->nop; ++i) {
+        if(w < g->mix[i])
+            return (lop[i]);
+        w -= g->mix[i];
+    }
+
+    return (lop[0]);
+}
+
+static struct ltx* lgn_txn(struct lgn *const g, uint64_t *const s)
+{
+    struct lpy *p;
+    struct ltx *x;
+    uint32_t i, n;
+    uint64_t l;
+
+    n = lgn_drw(&g->cpt, s);
+    if(n == 0)
+        n = 1;
+    errno = 0;
+    x = (struct ltx *)malloc(sizeof(struct ltx) + sizeof(struct lcm) * n);
+    if(!valid(x)) {
+        log_err("!valid(x)");
+        _exit(EXIT_FAILURE);
+    }
+    x->ncm = n;
+    for(i = 0; i < n; ++i) {
+        l = lgn_drw(&g->pay, s);
+        /* payloads live as long as the chain that refers to them */
+        errno = 0;
+        p = (struct lpy *)malloc(sizeof(struct lpy) + l);
+        if(!valid(p)) {
+            log_err("!valid(p)");
+            _exit(EXIT_FAILURE);
+        }
+        p->len = l;
+        memset(p->d, (int)(l & 0xff), l);
+        x->cm[i].fn = lgn_opc(g, s);
+        x->cm[i].arg = (uint64_t)(uintptr_t)p;
+    }
+
+    return (x);
+}
+
+/*
+ * open loop producer: submit times follow the schedule, not the chain,
+ * so a stalled builder shows up as latency and drops instead of slowing
+ * the offered load down.
+ */
+static void* lgn_prd(void *a)
+{
+    struct timespec t;
+    struct lpr *r;
+    struct ltx *x;
+    uint64_t n;
+    double o;
+
+    r = (struct lpr *)a;
+    o = (double)mtm_get();
+    while(!__atomic_load_n(&r->g->stp, __ATOMIC_ACQUIRE)) {
+        n = (uint64_t)o;
+        t.tv_sec = n / 1000000000UL;
+        t.tv_nsec = n % 1000000000UL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+
+        x = lgn_txn(r->g, &r->sed);
+        x->tsc = n;
+        __atomic_add_fetch(&r->g->gen, 1, __ATOMIC_RELAXED);
+        if(!rng_put(&r->g->q, x)) {
+            free(x);
+            __atomic_add_fetch(&r->g->drp, 1, __ATOMIC_RELAXED);
+        }
+        o += 1e9 / r->rat;
+    }
+
+    return (NULL);
+}
+
+static void lsm_put(struct lsm *const s, uint64_t v)
+{
+    if(s->n == s->m) {
+        s->m = s->m ? s->m * 2 : 4096;
+        errno = 0;
+        s->v = (uint64_t *)realloc(s->v, sizeof(uint64_t) * s->m);
+        if(!valid(s->v)) {
+            log_err("!valid(s->v)");
+            _exit(EXIT_FAILURE);
+        }
+    }
+    s->v[s->n++] = v;
+}
+
+static int lsm_cmp(const void *a, const void *b)
+{
+    uint64_t x, y;
+
+    x = *(const uint64_t *)a;
+    y = *(const uint64_t *)b;
+    return (x < y ? -1 : x > y);
+}
+
+static void lsm_prt(const char *nm, struct lsm *const s)
+{
+    static const double pq[] = {0.5, 0.9, 0.99, 0.999};
+    uint32_t i;
+
+    printf("%-4s", nm);
+    if(s->n == 0) {
+        printf(" no samples\n");
+        return;
+    }
+    qsort(s->v, s->n, sizeof(uint64_t), lsm_cmp);
+    for(i = 0; i < sizeof(pq) / sizeof(pq[0]); ++i)
+        printf(" p%g %.1f", pq[i] * 100,
+               s->v[(uint64_t)(pq[i] * (s->n - 1))] / 1000.0);
+    printf(" max %.1f us (%lu)\n", s->v[s->n - 1] / 1000.0, s->n);
+}
+
+/*
+ * usage: lgn [-b blocks_per_s] [-n blocks] [-t txns_per_block]
+ *            [-c cmds_per_txn] [-z payload_bytes] [-m w0,w1,w2,w3,w4]
+ *            [-p producers] [-x executors] [-q queue]
+ *            [-k tpb,cpt[,cpu,cpv]]
+ * -t, -c and -z take "n", "a-b" (uniform) or "em" (exponential, mean m).
+ * -m weighs the opcodes nop, read payload, hash payload, write state and
+ * fail, the last one 0 by default. receipts are scanned at the end.
+ * producers offer the mean txn rate of the -b and -t shape, the builder
+ * seals -b blocks a second taking a -t draw of txns each, executes them
+ * and finally walks the chain with blk_itr. -x 0 executes inline.
+ * -k sets the chain capacities (blk_cap), -t and -c are capped by them.
+ */
+int main(int argc, char **argv)
+{
+    struct timespec t;
+    struct lsm lt, lb;
+    struct rusage ru;
+    struct tpl *p;
+    struct blk *b, *r;
+    struct ltx *x;
+    struct lgn g;
+    uint64_t bps, nbk, ntx, ncm, nxt, ivl, t0, t1, ti, tr, k, n, sed, *gs;
+    uint32_t nf, nl;
+    const char *ts, *cs;
+    uint32_t i, nx, qd, c[4];
+    char *s;
+    int o;
+
+    memset(&g, 0, sizeof(g));
+    memset(&lt, 0, sizeof(lt));
+    memset(&lb, 0, sizeof(lb));
+    bps = 10;
+    nbk = 50;
+    nx = 0;
+    qd = LQD;
+    g.npr = 1;
+    g.nop = sizeof(lop) / sizeof(lop[0]);
+    ts = "1-16";
+    cs = "1-8";
+    c[0] = TPB;
+    c[1] = CPT;
+    c[2] = CPU;
+    c[3] = CPV;
+    lgn_dst(&g.pay, "64", LPL);
+    for(i = 0; i < g.nop - 1; ++i)
+        g.mix[i] = 1;
+    while((o = getopt(argc, argv, "b:c:k:m:n:p:q:t:x:z:")) != -1) {
+        switch(o) {
+        case 'b':
+            bps = strtoull(optarg, NULL, 10);
+            break;
+        case 'c':
+            cs = optarg;
+            break;
+        case 'k':
+            s = optarg;
+            for(i = 0; i < 4 && *s != '\0'; ++i) {
+                c[i] = strtoul(s, &s, 10);
+                if(*s == ',')
+                    ++s;
+            }
+            break;
+        case 'm':
+            s = optarg;
+            for(i = 0; i < g.nop; ++i) {
+                g.mix[i] = strtoul(s, &s, 10);
+                if(*s == ',')
+                    ++s;
+            }
+            break;
+        case 'n':
+            nbk = strtoull(optarg, NULL, 10);
+            break;
+        case 'p':
+            g.npr = strtoul(optarg, NULL, 10);
+            break;
+        case 'q':
+            qd = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            ts = optarg;
+            break;
+        case 'x':
+            nx = strtoul(optarg, NULL, 10);
+            break;
+        case 'z':
+            lgn_dst(&g.pay, optarg, LPL);
+            break;
+        default:
+            _exit(EXIT_FAILURE);
+        }
+    }
+    openlog("lgn", LOG_PID | LOG_PERROR, LOG_USER);
+    blk_cap(c[0], c[1], c[2], c[3]);
+    lgn_dst(&g.tpb, ts, bcp.tpb - 1);
+    lgn_dst(&g.cpt, cs, bcp.cpt);
+    for(i = 0; i < g.nop; ++i)
+        g.wsm += g.mix[i];
+    if(bps == 0 || nbk == 0 || g.wsm == 0 || g.npr == 0 || g.npr > LPM ||
+       qd == 0 || lgn_mea(&g.tpb) == 0) {
+        fprintf(stderr, "lgn: bad arguments\n");
+        _exit(EXIT_FAILURE);
+    }
+
+    for(i = 0; i < g.nop; ++i)
+        opc_reg(lop[i]);
+    p = NULL;
+    if(nx > 0) {
+        p = tpl_new(nx);
+        blk_pol(p);
+    }
+    rng_ini(&g.q, qd);
+
+    r = b = blk_add(INIT);
+    ivl = 1000000000UL / bps;
+    ntx = ncm = 0;
+    t0 = nxt = mtm_get();
+    sed = t0 | 1;
+    for(i = 0; i < g.npr; ++i) {
+        g.pr[i].g = &g;
+        g.pr[i].sed = t0 ^ (0x9e3779b97f4a7c15ULL * (i + 1));
+        g.pr[i].rat = bps * lgn_mea(&g.tpb) / g.npr;
+        errno = pthread_create(&g.pr[i].thr, NULL, lgn_prd, &g.pr[i]);
+        if(errno != 0) {
+            log_err("pthread_create()");
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    /* sealer: a tick every ivl on the absolute schedule, never skipped */
+    for(n = 0; n < nbk; ++n) {
+        nxt += ivl;
+        t.tv_sec = nxt / 1000000000UL;
+        t.tv_nsec = nxt % 1000000000UL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+
+        b = blk_add(b);
+        k = lgn_drw(&g.tpb, &sed);
+        while(k > 0 && (x = (struct ltx *)rng_get(&g.q)) != NULL) {
+            txn_add(b);
+            for(i = 0; i < x->ncm; ++i)
+                txn_addcmd(b, x->cm[i].fn, NULL, x->cm[i].arg);
+            ncm += x->ncm;
+            lsm_put(&lt, x->tsc);
+            free(x);
+            --k;
+        }
+        blk_run(b);
+        blk_hsh(b);
+        blk_sel(b);
+
+        /* txns stamped with submit times above, commit time now */
+        t1 = mtm_get();
+        for(k = lt.n - b->tdx; k < lt.n; ++k)
+            lt.v[k] = t1 - lt.v[k];
+        ntx += b->tdx;
+        lsm_put(&lb, t1 - nxt);
+    }
+    t1 = mtm_get();
+
+    __atomic_store_n(&g.stp, 1, __ATOMIC_RELEASE);
+    for(i = 0; i < g.npr; ++i)
+        pthread_join(g.pr[i].thr, NULL);
+
+    ti = mtm_get();
+    blk_itr(r);
+    ti = mtm_get() - ti;
+
+    /* receipt scans over the whole chain, bodies stay untouched */
+    errno = 0;
+    gs = (uint64_t *)malloc(sizeof(uint64_t) * blk_cnt());
+    if(!valid(gs)) {
+        log_err("!valid(gs)");
+        _exit(EXIT_FAILURE);
+    }
+    tr = mtm_get();
+    nf = rcp_fld(0, blk_cnt(), NULL, 0);
+    nl = rcp_lgf(0, blk_cnt(), g.pay.a, NULL, 0);
+    rcp_gsm(0, blk_cnt(), gs);
+    tr = mtm_get() - tr;
+    for(i = 0, k = 0; i < blk_cnt(); ++i)
+        k += gs[i];
+
+    getrusage(RUSAGE_SELF, &ru);
+    printf("load %lu blk/s, %u producers, %u executors, offered %.1f txn/s\n",
+           bps, g.npr, nx, bps * lgn_mea(&g.tpb));
+    printf("done %lu blocks %lu txns %lu cmds in %.3f s: %.1f blk/s "
+           "%.1f txn/s %.1f cmd/s\n", nbk, ntx, ncm, (t1 - t0) / 1e9,
+           nbk / ((t1 - t0) / 1e9), ntx / ((t1 - t0) / 1e9),
+           ncm / ((t1 - t0) / 1e9));
+    printf("gen  %lu txns, %lu dropped on a full queue, %lu left queued\n",
+           g.gen, g.drp, g.gen - g.drp - ntx);
+    lsm_prt("txn", &lt);
+    lsm_prt("blk", &lb);
+    printf("itr  %u blocks %.1f ms, %.1f ns/cmd (%lu)\n", blk_cnt(),
+           ti / 1e6, ncm ? (double)ti / ncm : 0, lgn_sum);
+    printf("rcp  %u failed txns, %lu gas, %u txns logged %lu, "
+           "3 scans %.1f ns/blk\n", nf, k, nl, g.pay.a,
+           (double)tr / blk_cnt());
+    printf("rss  peak %ld KB\n", ru.ru_maxrss);
+
+    if(p != NULL)
+        tpl_del(p);
+    free(gs);
+    free(lt.v);
+    free(lb.v);
+    closelog();
+
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,393 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * mem.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <fcntl.h>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <mem.h>
+#include <utl.h>
+
+/* alignment of anything a cache line or larger */
+#define MCA     64
+
+static struct mem mem;
+static __thread int32_t pin = -1;
+
+/* parse a cpu list such as 0-3,8 into m, stopping at ':' or the end */
+static const char* mem_cpl(const char *s, uint64_t m[MCW], uint32_t *n)
+{
+    unsigned long a, b;
+    char *e;
+
+    while(*s != '\0' && *s != ':' && *s != '\n') {
+        a = strtoul(s, &e, 10);
+        if(e == s) {
+            log_err("bad cpu list %s", s);
+            _exit(EXIT_FAILURE);
+        }
+        b = a;
+        if(*e == '-')
+            b = strtoul(e + 1, &e, 10);
+        for(; a <= b && a < MCW * 64; ++a) {
+            if(!(m[a / 64] & (1ULL << (a % 64))))
+                (*n)++;
+            m[a / 64] |= 1ULL << (a % 64);
+        }
+        s = *e == ',' ? e + 1 : e;
+    }
+
+    return (s);
+}
+
+/* nodes with cpus from sysfs, one node holding every cpu if there is none */
+static void mem_sys(void)
+{
+    char p[64], l[1024];
+    ssize_t r;
+    uint32_t i;
+    int fd;
+
+    for(i = 0; i < 64 && mem.nnd < MND; ++i) {
+        snprintf(p, sizeof(p), "/sys/devices/system/node/node%u/cpulist", i);
+        fd = open(p, O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            continue;
+        r = read(fd, l, sizeof(l) - 1);
+        close(fd);
+        if(r <= 0)
+            continue;
+        l[r] = '\0';
+        memset(mem.nod[mem.nnd].cpu, 0, sizeof(mem.nod[0].cpu));
+        mem.nod[mem.nnd].ncp = 0;
+        mem_cpl(l, mem.nod[mem.nnd].cpu, &mem.nod[mem.nnd].ncp);
+        if(mem.nod[mem.nnd].ncp == 0)
+            continue;
+        mem.nod[mem.nnd++].nid = i;
+    }
+
+    if(mem.nnd == 0)
+        mem.nnd = 1;
+}
+
+/* prefer the node of d for [p, p+n), a no-op without MEM_NUM */
+static int mem_bnd(struct mnd *const d, void *p, uint64_t n)
+{
+    unsigned long m;
+
+    if(!(mem.mod & MEM_NUM))
+        return (0);
+
+    m = 1UL << (d->nid % 64);
+    return (syscall(SYS_mbind, p, n, MPOL_PREFERRED, &m, 64, 0) != 0);
+}
+
+/* ask for transparent huge pages over the small half of d from offset o */
+static void mem_thp(struct mnd *const d, uint64_t o)
+{
+    if(madvise(d->bas + o, mem.spn / 2 - o, MADV_HUGEPAGE) != 0) {
+        log_wrn("no transparent huge pages");
+        __atomic_store_n(&mem.hpg, MHP_NON, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_store_n(&mem.hpg, MHP_THP, __ATOMIC_RELAXED);
+}
+
+/* hugetlb pages are reserved per chunk as the small half grows */
+static void mem_cmt(struct mnd *const d, uint64_t e)
+{
+    void *p;
+
+    for(; d->cmt < e; d->cmt += MHP) {
+        p = mmap(d->bas + d->cmt, MHP, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+        if(p == MAP_FAILED)
+            break;
+        mem_bnd(d, p, MHP);
+    }
+    if(d->cmt >= e)
+        return;
+
+    /* pool exhausted, the rest of this node falls back to transparent pages */
+    p = mmap(d->bas + d->cmt, MHP, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+    if(p == MAP_FAILED) {
+        log_err("cannot remap node arena");
+        _exit(EXIT_FAILURE);
+    }
+    mem_bnd(d, p, MHP);
+    mem_thp(d, d->cmt);
+    d->cmt = UINT64_MAX;
+}
+
+/* a forked child finds every arena unlocked */
+static void mem_fkl(void)
+{
+    uint32_t i;
+
+    for(i = 0; i < mem.nnd; ++i)
+        pthread_mutex_lock(&mem.nod[i].mtx);
+}
+
+static void mem_fku(void)
+{
+    uint32_t i;
+
+    for(i = mem.nnd; i-- > 0; )
+        pthread_mutex_unlock(&mem.nod[i].mtx);
+}
+
+/*
+ * select the backend and node layout. top overrides the topology with
+ * colon separated cpu lists, one per node, e.g. "0-3:4-7"; simulated nodes
+ * past the real ones keep their own queues and arenas but cannot bind.
+ */
+uint32_t mem_ini(uint32_t mod, const char *top)
+{
+    uint8_t *b;
+    uint32_t i;
+
+    if(mem.nnd != 0) {
+        log_err("mem_ini() called twice");
+        _exit(EXIT_FAILURE);
+    }
+
+    if(top != NULL) {
+        while(*top != '\0' && mem.nnd < MND) {
+            top = mem_cpl(top, mem.nod[mem.nnd].cpu, &mem.nod[mem.nnd].ncp);
+            mem.nod[mem.nnd].nid = mem.nnd;
+            mem.nnd++;
+            if(*top == ':')
+                top++;
+        }
+        if(mem.nnd == 0)
+            mem.nnd = 1;
+    } else {
+        mem_sys();
+    }
+
+    mem.mod = mod;
+    if(mod == MEM_SYS)
+        return (mem.nnd);
+
+    /* address space only, pages are faulted in on the node they are bound to */
+    for(mem.spn = MSP; mem.spn >= (1ULL << 30); mem.spn >>= 2) {
+        b = (uint8_t *)mmap(NULL, mem.spn * mem.nnd + MHP,
+                            PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(b != MAP_FAILED)
+            break;
+    }
+    if(b == MAP_FAILED) {
+        log_err("cannot reserve node arenas");
+        _exit(EXIT_FAILURE);
+    }
+    mem.bas = (uint8_t *)(((uintptr_t)b + MHP - 1) & ~((uintptr_t)MHP - 1));
+
+    mem.hpg = mod & MEM_HUG ? MHP_TLB : MHP_NON;
+    for(i = 0; i < mem.nnd; ++i) {
+        pthread_mutex_init(&mem.nod[i].mtx, NULL);
+        mem.nod[i].bas = mem.bas + mem.spn * i;
+        mem.nod[i].cmt = mem.hpg == MHP_TLB ? 0 : UINT64_MAX;
+        if(mem_bnd(&mem.nod[i], mem.nod[i].bas, mem.spn) != 0)
+            log_wrn("node %u arena not bound", i);
+        if(mem.hpg == MHP_TLB)
+            mem_cmt(&mem.nod[i], MHP);
+        else if(mod & MEM_HUG)
+            mem_thp(&mem.nod[i], 0);
+    }
+    pthread_atfork(mem_fkl, mem_fku, mem_fku);
+
+    return (mem.nnd);
+}
+
+uint32_t mem_nnd(void)
+{
+    return (mem.nnd ? mem.nnd : 1);
+}
+
+/* node of the calling thread, its pinned node if it has one */
+uint32_t mem_nod(void)
+{
+    unsigned c;
+    uint32_t i;
+
+    if(pin >= 0)
+        return (pin);
+    if(mem.nnd <= 1 || syscall(SYS_getcpu, &c, NULL, NULL) != 0)
+        return (0);
+
+    for(i = 0; i < mem.nnd; ++i)
+        if(c < MCW * 64 && (mem.nod[i].cpu[c / 64] & (1ULL << (c % 64))))
+            return (i);
+
+    return (c % mem.nnd);
+}
+
+/* node whose arena holds p, the caller's node for system memory */
+uint32_t mem_own(const void *const p)
+{
+    if(mem.mod == MEM_SYS || (const uint8_t *)p < mem.bas ||
+       (const uint8_t *)p >= mem.bas + mem.spn * mem.nnd)
+        return (mem_nod());
+
+    return ((uint32_t)(((const uint8_t *)p - mem.bas) / mem.spn));
+}
+
+/* bind the calling thread to the cpus of node n */
+void mem_pin(uint32_t n)
+{
+    n %= mem_nnd();
+    pin = n;
+    if(mem.nod[n].ncp == 0)
+        return;
+
+    if(syscall(SYS_sched_setaffinity, 0, sizeof(mem.nod[n].cpu),
+               mem.nod[n].cpu) != 0)
+        log_wrn("cannot pin to node %u", n);
+}
+
+uint64_t mem_use(uint32_t n)
+{
+    uint64_t u;
+
+    if(mem.mod == MEM_SYS || n >= mem.nnd)
+        return (0);
+
+    pthread_mutex_lock(&mem.nod[n].mtx);
+    u = mem.nod[n].use;
+    pthread_mutex_unlock(&mem.nod[n].mtx);
+
+    return (u);
+}
+
+/* 1 when p lies in the lower half of its node arena, the huge page half */
+int mem_lwr(const void *const p)
+{
+    uint64_t o;
+
+    if(mem.mod == MEM_SYS || (const uint8_t *)p < mem.bas ||
+       (const uint8_t *)p >= mem.bas + mem.spn * mem.nnd)
+        return (0);
+    o = (uint64_t)((const uint8_t *)p - mem.bas) % mem.spn;
+
+    return (o < mem.spn / 2);
+}
+
+uint32_t mem_hpg(void)
+{
+    return (__atomic_load_n(&mem.hpg, __ATOMIC_RELAXED));
+}
+
+static uint32_t mem_cls(size_t n)
+{
+    uint32_t c;
+
+    for(c = 0; c < MCL && ((size_t)MMN << c) < n; ++c)
+        ;
+    if(c == MCL) {
+        log_err("allocation of %zu bytes too large", n);
+        _exit(EXIT_FAILURE);
+    }
+
+    return (c);
+}
+
+/* z bytes, a aligned, off the top of half h of node d; d is locked */
+static void* mem_bmp(struct mnd *const d, uint32_t h, uint64_t z, uint64_t a)
+{
+    uint64_t o;
+
+    o = (d->top[h] + a - 1) & ~(a - 1);
+    if(o + z > mem.spn / 2) {
+        log_err("node arena exhausted");
+        _exit(EXIT_FAILURE);
+    }
+    d->top[h] = o + z;
+    if(h == 0 && d->cmt != UINT64_MAX && o + z > d->cmt)
+        mem_cmt(d, o + z);
+
+    return (d->bas + mem.spn / 2 * h + o);
+}
+
+void* mem_alc(size_t n)
+{
+    return (mem_aln(mem_nod(), n));
+}
+
+/* n bytes on node d, cache line aligned from 64 bytes up */
+void* mem_aln(uint32_t d, size_t n)
+{
+    struct mnd *m;
+    uint8_t *s;
+    uint64_t z;
+    uint32_t c, i;
+    void *p;
+
+    if(mem.mod == MEM_SYS) {
+        p = NULL;
+        errno = posix_memalign(&p, n >= MCA ? MCA : sizeof(void *),
+                               n ? n : 1);
+        if(!valid(p)) {
+            log_err("!valid(p)");
+            _exit(EXIT_FAILURE);
+        }
+        return (p);
+    }
+
+    m = &mem.nod[d % mem.nnd];
+    c = mem_cls(n);
+    z = (uint64_t)MMN << c;
+
+    pthread_mutex_lock(&m->mtx);
+    if(m->fre[c] == NULL) {
+        if(z < MPG) {
+            /* small classes are carved a slab at a time, so equal sizes pack */
+            s = (uint8_t *)mem_bmp(m, 0, MSL, MPG);
+            for(i = MSL / z; i-- > 0; ) {
+                *(void **)(s + i * z) = m->fre[c];
+                m->fre[c] = s + i * z;
+            }
+        } else {
+            m->fre[c] = mem_bmp(m, z >= MSL, z, MPG);
+            *(void **)m->fre[c] = NULL;
+        }
+    }
+    p = m->fre[c];
+    m->fre[c] = *(void **)p;
+    m->use += z;
+    pthread_mutex_unlock(&m->mtx);
+
+    return (p);
+}
+
+void mem_fre(void *const p, size_t n)
+{
+    struct mnd *m;
+    uint32_t c;
+
+    if(p == NULL)
+        return;
+    if(mem.mod == MEM_SYS) {
+        free(p);
+        return;
+    }
+
+    m = &mem.nod[mem_own(p)];
+    c = mem_cls(n);
+    /* hand large blocks back to the kernel, keep the address range */
+    if(((size_t)MMN << c) >= MSL)
+        madvise(p, (size_t)MMN << c, MADV_DONTNEED);
+
+    pthread_mutex_lock(&m->mtx);
+    *(void **)p = m->fre[c];
+    m->fre[c] = p;
+    m->use -= (uint64_t)MMN << c;
+    pthread_mutex_unlock(&m->mtx);
+}
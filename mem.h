@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * mem.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _MEM_H
+#define _MEM_H
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* most nodes, cpu mask words per node */
+#define MND     8
+#define MCW     4
+/* address space reserved per node */
+#define MSP     (1ULL << 40)
+/* slab carved into objects of one small class */
+#define MSL     (1U << 16)
+/* size classes 16 bytes .. 64 MB, classes below MPG come from slabs */
+#define MCL     23
+#define MMN     16
+#define MPG     4096
+/* huge page */
+#define MHP     (1U << 21)
+
+/*
+ * allocation backends, chosen once by mem_ini before the chain is built.
+ * MEM_NUM binds node arenas, MEM_HUG backs their small object half with
+ * 2 MB pages; either one turns the arenas on.
+ */
+#define MEM_SYS 0
+#define MEM_NUM 1
+#define MEM_HUG 2
+
+/* huge pages in use: none, transparent (madvise) or hugetlbfs */
+enum {MHP_NON = 0, MHP_THP, MHP_TLB};
+
+/*
+ * per node arena: one reserved address range bound to the node, carved by
+ * bump pointers into power of two classes with per class free lists.
+ * objects under MSL pack into the lower half, which is the half backed by
+ * huge pages, larger ones go to the upper half in base pages. the range a
+ * pointer falls in tells which node owns it.
+ */
+struct mnd {
+    pthread_mutex_t mtx;
+    uint8_t *bas;
+    uint64_t top[2];
+    uint64_t cmt;
+    uint64_t use;
+    void *fre[MCL];
+    uint64_t cpu[MCW];
+    uint32_t nid;
+    uint32_t ncp;
+};
+
+struct mem {
+    struct mnd nod[MND];
+    uint8_t *bas;
+    uint64_t spn;
+    uint32_t mod;
+    uint32_t nnd;
+    uint32_t hpg;
+};
+
+uint32_t mem_ini(uint32_t mod, const char *top);
+uint32_t mem_nnd(void);
+uint32_t mem_nod(void);
+uint32_t mem_own(const void *const p);
+void mem_pin(uint32_t n);
+uint64_t mem_use(uint32_t n);
+uint32_t mem_hpg(void);
+int mem_lwr(const void *const p);
+void* mem_alc(size_t n);
+void* mem_aln(uint32_t d, size_t n);
+void mem_fre(void *const p, size_t n);
+
+#endif
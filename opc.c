@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * opc.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <opc.h>
+#include <utl.h>
+
+/* id -> function, and an open addressed function -> id table */
+static fcnt_t ofn[OPM];
+static fcnt_t ohk[OPM * 2];
+static uint32_t ohv[OPM * 2];
+static uint32_t ocn = 0;
+
+static uint32_t opc_slt(fcnt_t fn)
+{
+    uint32_t h;
+
+    h = (uint32_t)(((uintptr_t)fn >> 4) * 2654435761U) & (OPM * 2 - 1);
+    while(ohk[h] != NULL && ohk[h] != fn)
+        h = (h + 1) & (OPM * 2 - 1);
+
+    return (h);
+}
+
+/* register fn, returns its id; registering twice returns the same id */
+uint32_t opc_reg(fcnt_t fn)
+{
+    uint32_t h;
+
+    if(fn == NULL) {
+        log_err("fn is NULL");
+        _exit(EXIT_FAILURE);
+    }
+
+    h = opc_slt(fn);
+    if(ohk[h] == fn)
+        return (ohv[h]);
+
+    if(ocn >= OPM) {
+        log_err("opcode table is full");
+        _exit(EXIT_FAILURE);
+    }
+
+    ofn[ocn] = fn;
+    ohk[h] = fn;
+    ohv[h] = ocn;
+
+    return (ocn++);
+}
+
+/* id of fn, OPX when fn was never registered */
+uint32_t opc_get(fcnt_t fn)
+{
+    uint32_t h;
+
+    h = opc_slt(fn);
+
+    return (ohk[h] == fn ? ohv[h] : OPX);
+}
+
+fcnt_t opc_fn(uint32_t o)
+{
+    return (o < ocn ? ofn[o] : NULL);
+}
+
+uint32_t opc_cnt(void)
+{
+    return (ocn);
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * opc.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _OPC_H
+#define _OPC_H
+#include <stdint.h>
+#include <blk.h>
+
+/*
+ * command opcodes. function pointers do not survive leaving the process,
+ * so commands travel as the id they were registered under. every process
+ * that exchanges blocks registers the same commands in the same order,
+ * at startup before any block is built.
+ */
+#define OPM     256
+#define OPX     UINT32_MAX
+
+uint32_t opc_reg(fcnt_t fn);
+uint32_t opc_get(fcnt_t fn);
+fcnt_t opc_fn(uint32_t o);
+uint32_t opc_cnt(void);
+
+#endif
@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * ppl.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <sched.h>
+#include <ppl.h>
+#include <sig.h>
+#include <utl.h>
+
+static uint64_t ppl_tsm(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec*1000000000UL + tp.tv_nsec;
+}
+
+static void pps_add(struct pps *const s, uint64_t d)
+{
+    uint64_t m;
+
+    __atomic_add_fetch(&s->cnt, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->tns, d, __ATOMIC_RELAXED);
+    m = __atomic_load_n(&s->mns, __ATOMIC_RELAXED);
+    while(d > m && !__atomic_compare_exchange_n(&s->mns, &m, d, 1,
+                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/* spin on an empty input ring, NULL once the pipeline is stopping */
+static struct ppi* ppl_get(struct ppl *const p, struct rng *const r)
+{
+    struct ppi *i;
+
+    while((i = (struct ppi *)rng_get(r)) == NULL) {
+        if(__atomic_load_n(&p->stp, __ATOMIC_ACQUIRE))
+            return (NULL);
+        sched_yield();
+    }
+
+    return (i);
+}
+
+/* push to a bounded ring, counting full ring stalls against stage s */
+static void ppl_psh(struct ppl *const p, struct rng *const r,
+                    struct ppi *const i, uint32_t s)
+{
+    while(!rng_put(r, i)) {
+        __atomic_add_fetch(&p->sts[s].stl, 1, __ATOMIC_RELAXED);
+        sched_yield();
+    }
+}
+
+static void* ppl_dec(void *a)
+{
+    struct ppl *p;
+    struct ppi *i;
+    uint64_t t;
+
+    p = (struct ppl *)a;
+    while((i = ppl_get(p, &p->in)) != NULL) {
+        t = ppl_tsm();
+        i->ok = blk_chk(i->b);
+        pps_add(&p->sts[PDC], ppl_tsm() - t);
+        ppl_psh(p, &p->ex, i, PDC);
+        ppl_psh(p, &p->hv, i, PDC);
+    }
+
+    return (NULL);
+}
+
+static void* ppl_hvf(void *a)
+{
+    struct ppl *p;
+    struct ppi *i;
+    uint64_t t;
+
+    p = (struct ppl *)a;
+    while((i = ppl_get(p, &p->hv)) != NULL) {
+        t = ppl_tsm();
+        if(i->ok) {
+            blk_hsh(i->b);
+            if(p->vfy)
+                i->ok = sig_blk(i->b, p->vpl);
+        }
+        pps_add(&p->sts[PHV], ppl_tsm() - t);
+        __atomic_store_n(&i->rdy, 1, __ATOMIC_RELEASE);
+    }
+
+    return (NULL);
+}
+
+static void* ppl_exe(void *a)
+{
+    struct ppl *p;
+    struct ppi *i;
+    uint64_t t;
+
+    p = (struct ppl *)a;
+    while((i = ppl_get(p, &p->ex)) != NULL) {
+        /* keep submission order, wait for this block's hash stage */
+        while(!__atomic_load_n(&i->rdy, __ATOMIC_ACQUIRE))
+            sched_yield();
+        t = ppl_tsm();
+        if(i->ok)
+            blk_run(i->b);
+        pps_add(&p->sts[PEX], ppl_tsm() - t);
+        ppl_psh(p, &p->cm, i, PEX);
+    }
+
+    return (NULL);
+}
+
+static void* ppl_cmt(void *a)
+{
+    struct ppl *p;
+    struct ppi *i;
+    uint64_t t;
+
+    p = (struct ppl *)a;
+    while((i = ppl_get(p, &p->cm)) != NULL) {
+        t = ppl_tsm();
+        if(i->ok)
+            blk_sel(i->b);
+        if(p->cb != NULL)
+            p->cb(i->b, i->ok, p->a);
+        pps_add(&p->sts[PCM], ppl_tsm() - t);
+        pps_add(&p->lat, ppl_tsm() - i->tin);
+        i->b = NULL;
+        i->rdy = 0;
+        __atomic_add_fetch(&p->dne, 1, __ATOMIC_RELEASE);
+        ppl_psh(p, &p->fre, i, PCM);
+    }
+
+    return (NULL);
+}
+
+struct ppl* ppl_new(uint32_t nin, uint32_t nhv, pcb_t cb, void *a)
+{
+    struct ppl *p;
+    uint32_t i;
+
+    if(nin == 0 || nhv == 0) {
+        log_err("nin == 0 || nhv == 0");
+        _exit(EXIT_FAILURE);
+    }
+
+    errno = 0;
+    p = (struct ppl *)calloc(1, sizeof(struct ppl));
+    if(!valid(p)) {
+        log_err("!valid(p)");
+        _exit(EXIT_FAILURE);
+    }
+
+    errno = 0;
+    p->itm = (struct ppi *)calloc(nin, sizeof(struct ppi));
+    p->thr = (pthread_t *)calloc(nhv + 3, sizeof(pthread_t));
+    if(!valid(p->itm) || !valid(p->thr)) {
+        log_err("!valid(p->itm) || !valid(p->thr)");
+        _exit(EXIT_FAILURE);
+    }
+
+    rng_ini(&p->fre, nin);
+    rng_ini(&p->in, nin);
+    rng_ini(&p->hv, nin);
+    rng_ini(&p->ex, nin);
+    rng_ini(&p->cm, nin);
+    for(i = 0; i < nin; ++i)
+        rng_put(&p->fre, &p->itm[i]);
+
+    p->cb = cb;
+    p->a = a;
+    p->nin = nin;
+    p->nhv = nhv;
+
+    errno = pthread_create(&p->thr[0], NULL, ppl_dec, p);
+    for(i = 0; i < nhv && errno == 0; ++i)
+        errno = pthread_create(&p->thr[1 + i], NULL, ppl_hvf, p);
+    if(errno == 0)
+        errno = pthread_create(&p->thr[nhv + 1], NULL, ppl_exe, p);
+    if(errno == 0)
+        errno = pthread_create(&p->thr[nhv + 2], NULL, ppl_cmt, p);
+    if(errno != 0) {
+        log_err("pthread_create()");
+        _exit(EXIT_FAILURE);
+    }
+
+    return (p);
+}
+
+/*
+ * require valid txn signatures from now on, batches are spread over v or
+ * checked on the hash stage threads when v is NULL. call before ppl_put.
+ */
+void ppl_vfy(struct ppl *const p, struct tpl *const v)
+{
+    if(!valid(p)) {
+        log_err("!valid(p)");
+        _exit(EXIT_FAILURE);
+    }
+
+    p->vpl = v;
+    __atomic_store_n(&p->vfy, 1, __ATOMIC_RELEASE);
+}
+
+/* submit b, blocks in submission order must be parent before child */
+void ppl_put(struct ppl *const p, struct blk *const b)
+{
+    struct ppi *i;
+
+    if(!valid(p) || !valid(b)) {
+        log_err("!valid(p) || !valid(b)");
+        _exit(EXIT_FAILURE);
+    }
+
+    /* backpressure: wait for a free slot once nin blocks are in flight */
+    while((i = (struct ppi *)rng_get(&p->fre)) == NULL) {
+        __atomic_add_fetch(&p->sts[PDC].stl, 1, __ATOMIC_RELAXED);
+        sched_yield();
+    }
+
+    i->b = b;
+    i->ok = 0;
+    i->tin = ppl_tsm();
+    p->sub++;
+    ppl_psh(p, &p->in, i, PDC);
+}
+
+/* wait until every submitted block is committed */
+void ppl_drn(struct ppl *const p)
+{
+    while(__atomic_load_n(&p->dne, __ATOMIC_ACQUIRE) != p->sub)
+        sched_yield();
+}
+
+static void pps_cpy(struct pps *const o, struct pps *const s)
+{
+    o->cnt = __atomic_load_n(&s->cnt, __ATOMIC_RELAXED);
+    o->tns = __atomic_load_n(&s->tns, __ATOMIC_RELAXED);
+    o->mns = __atomic_load_n(&s->mns, __ATOMIC_RELAXED);
+    o->stl = __atomic_load_n(&s->stl, __ATOMIC_RELAXED);
+}
+
+/* snapshot per stage counters and end to end submit-to-commit latency */
+void ppl_sts(struct ppl *const p, struct pps o[PNS], struct pps *const l)
+{
+    uint32_t i;
+
+    for(i = 0; i < PNS; ++i)
+        pps_cpy(&o[i], &p->sts[i]);
+    if(l != NULL)
+        pps_cpy(l, &p->lat);
+}
+
+void ppl_del(struct ppl *const p)
+{
+    uint32_t i;
+
+    if(!valid(p))
+        return;
+
+    ppl_drn(p);
+    __atomic_store_n(&p->stp, 1, __ATOMIC_RELEASE);
+    for(i = 0; i < p->nhv + 3; ++i)
+        pthread_join(p->thr[i], NULL);
+
+    rng_fre(&p->fre);
+    rng_fre(&p->in);
+    rng_fre(&p->hv);
+    rng_fre(&p->ex);
+    rng_fre(&p->cm);
+    free(p->itm);
+    free(p->thr);
+    free(p);
+}
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * ppl.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _PPL_H
+#define _PPL_H
+#include <pthread.h>
+#include <stdint.h>
+#include <blk.h>
+#include <rng.h>
+
+/* stages, in the order a block passes through them */
+enum {PDC, PHV, PEX, PCM, PNS};
+
+/* per stage counters, times in ns */
+struct pps {
+    uint64_t cnt;
+    uint64_t tns;
+    uint64_t mns;
+    uint64_t stl;
+};
+
+struct ppi {
+    struct blk *b;
+    uint64_t tin;
+    uint32_t rdy;
+    uint32_t ok;
+};
+
+typedef void (*pcb_t)(struct blk *const b, int ok, void *a);
+
+/*
+ * block pipeline: decode -> hash/verify -> execute -> commit. hashing runs
+ * on nhv threads and may finish out of order, execute and commit keep
+ * submission order. at most nin blocks are in flight, ppl_put spins when
+ * the pipeline is full. a block must not be modified after ppl_put.
+ */
+struct ppl {
+    struct rng fre;
+    struct rng in;
+    struct rng hv;
+    struct rng ex;
+    struct rng cm;
+    struct ppi *itm;
+    pthread_t *thr;
+    struct tpl *vpl;
+    pcb_t cb;
+    void *a;
+    uint32_t nin;
+    uint32_t nhv;
+    uint32_t stp;
+    uint32_t vfy;
+    uint64_t sub;
+    uint64_t dne;
+    struct pps sts[PNS];
+    struct pps lat;
+};
+
+struct ppl* ppl_new(uint32_t nin, uint32_t nhv, pcb_t cb, void *a);
+void ppl_vfy(struct ppl *const p, struct tpl *const v);
+void ppl_put(struct ppl *const p, struct blk *const b);
+void ppl_drn(struct ppl *const p);
+void ppl_sts(struct ppl *const p, struct pps o[PNS], struct pps *const l);
+void ppl_del(struct ppl *const p);
+
+#endif
@@ -0,0 +1,265 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * prf.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <prf.h>
+#include <utl.h>
+
+uint32_t prf_flg = 0;
+
+static struct prf prf = { .mtx = PTHREAD_MUTEX_INITIALIZER };
+static __thread int pfd = -1;
+static __thread uint32_t pmk;
+static __thread uint32_t pin;
+
+static const char *const pcn[PRN] = {
+    "cycles", "instructions", "llc_miss", "dtlb_miss", "branch_miss"
+};
+
+static const char *const ppn[PRP_N] = {
+    "blk_add", "txn_add", "txn_addcmd", "execute"
+};
+
+static int prf_evt(uint32_t typ, uint64_t cfg, int grp, uint64_t fmt)
+{
+    struct perf_event_attr a;
+
+    memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.type = typ;
+    a.config = cfg;
+    a.read_format = fmt;
+    a.exclude_kernel = 1;
+    a.exclude_hv = 1;
+
+    return ((int)syscall(SYS_perf_event_open, &a, 0, -1, grp, 0));
+}
+
+/* user space counter for the calling thread, -1 when the kernel refuses */
+int prf_opn(uint32_t typ, uint64_t cfg)
+{
+    return (prf_evt(typ, cfg, -1, 0));
+}
+
+uint64_t prf_get(int fd)
+{
+    uint64_t v;
+
+    if(fd < 0 || read(fd, &v, sizeof(v)) != sizeof(v))
+        return (0);
+
+    return (v);
+}
+
+void prf_cls(int fd)
+{
+    if(fd >= 0)
+        close(fd);
+}
+
+/* open the calling thread's group, leaving out what the kernel refuses */
+static void prf_thr(void)
+{
+    static const uint32_t typ[PRN] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE
+    };
+    static const uint64_t cfg[PRN] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PRF_LLC,
+        PRF_DTL, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    uint32_t i;
+    int fd, e;
+
+    pin = 1;
+    e = 0;
+    for(i = 0; i < PRN; ++i) {
+        fd = prf_evt(typ[i], cfg[i], pfd, PERF_FORMAT_GROUP);
+        if(fd < 0) {
+            e = errno;
+            continue;
+        }
+        if(pfd < 0)
+            pfd = fd;
+        pmk |= 1U << i;
+    }
+
+    pthread_mutex_lock(&prf.mtx);
+    prf.msk |= pmk;
+    if(e != 0)
+        prf.err = e;
+    pthread_mutex_unlock(&prf.mtx);
+}
+
+static void prf_red(struct prv *const s)
+{
+    uint64_t b[PRN + 1];
+    struct timespec tp;
+    uint32_t i, k;
+
+    memset(s, 0, sizeof(*s));
+    if(pfd >= 0 && read(pfd, b, sizeof(b)) > 0)
+        for(i = 0, k = 1; i < PRN; ++i)
+            if(pmk & (1U << i))
+                s->v[i] = b[k++];
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    s->v[PRN] = tp.tv_sec*1000000000UL + tp.tv_nsec;
+}
+
+static void prf_acc(struct pra *const a, const struct prv *const s,
+                    struct prv *const e)
+{
+    uint32_t i;
+
+    prf_red(e);
+    for(i = 0; i <= PRN; ++i) {
+        e->v[i] -= s->v[i];
+        __atomic_add_fetch(&a->v[i], e->v[i], __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&a->cnt, 1, __ATOMIC_RELAXED);
+}
+
+/* turn profiling on, returns the number of hardware counters available */
+uint32_t prf_ini(const char *path)
+{
+    prf.pth = path;
+    prf_thr();
+    __atomic_store_n(&prf_flg, 1, __ATOMIC_RELEASE);
+
+    return (__builtin_popcount(prf.msk));
+}
+
+void prf_beg(struct prv *const s)
+{
+    if(!pin)
+        prf_thr();
+    prf_red(s);
+}
+
+void prf_end(uint32_t p, struct prv *const s)
+{
+    struct prv e;
+
+    prf_acc(&prf.phs[p], s, &e);
+}
+
+/* a command of opcode o ran since s, OPX for unregistered commands */
+void prf_opc(uint32_t o, struct prv *const s)
+{
+    struct prv e;
+
+    prf_acc(&prf.opc[o < OPM ? o : OPM], s, &e);
+}
+
+/* b, c commands, was executed since s; b may be frozen again by now */
+void prf_blk(const struct blk *const b, uint32_t c, struct prv *const s)
+{
+    struct prb *n;
+    struct prv e;
+
+    prf_acc(&prf.phs[PRP_EXE], s, &e);
+
+    pthread_mutex_lock(&prf.mtx);
+    if(prf.nbk == prf.cbk) {
+        prf.cbk = prf.cbk ? prf.cbk * 2 : 1024;
+        errno = 0;
+        n = (struct prb *)realloc(prf.blk, sizeof(struct prb) * prf.cbk);
+        if(!valid(n)) {
+            log_err("!valid(n)");
+            _exit(EXIT_FAILURE);
+        }
+        prf.blk = n;
+    }
+    prf.blk[prf.nbk].bnm = b->bnm;
+    prf.blk[prf.nbk].ncm = c;
+    memcpy(prf.blk[prf.nbk++].v, e.v, sizeof(e.v));
+    pthread_mutex_unlock(&prf.mtx);
+}
+
+static void prf_row(FILE *f, const uint64_t v[PRN + 1])
+{
+    uint32_t i;
+
+    fprintf(f, " %lu", v[PRN]);
+    for(i = 0; i < PRN; ++i) {
+        if(prf.msk & (1U << i))
+            fprintf(f, " %lu", v[i]);
+        else
+            fprintf(f, " -");
+    }
+    if((prf.msk & 3) == 3 && v[PRC_CYC] != 0)
+        fprintf(f, " %.2f\n", (double)v[PRC_INS] / v[PRC_CYC]);
+    else
+        fprintf(f, " -\n");
+}
+
+static void prf_hdr(FILE *f, const char *k)
+{
+    uint32_t i;
+
+    fprintf(f, "%s ns", k);
+    for(i = 0; i < PRN; ++i)
+        fprintf(f, " %s", pcn[i]);
+    fprintf(f, " ipc\n");
+}
+
+/* write phase, opcode and block tables, - marks an unavailable counter */
+int prf_rep(void)
+{
+    uint32_t i;
+    FILE *f;
+
+    if(prf.pth == NULL)
+        return (-1);
+
+    f = fopen(prf.pth, "w");
+    if(f == NULL) {
+        log_wrn("cannot write %s", prf.pth);
+        return (-1);
+    }
+
+    pthread_mutex_lock(&prf.mtx);
+    fprintf(f, "# unavailable:");
+    for(i = 0; i < PRN; ++i)
+        if(!(prf.msk & (1U << i)))
+            fprintf(f, " %s", pcn[i]);
+    if(prf.err != 0)
+        fprintf(f, " (%s)", strerror(prf.err));
+    fprintf(f, "\n\n[phase]\n");
+    prf_hdr(f, "phase calls");
+    for(i = 0; i < PRP_N; ++i) {
+        fprintf(f, "%s %lu", ppn[i], prf.phs[i].cnt);
+        prf_row(f, prf.phs[i].v);
+    }
+
+    fprintf(f, "\n[opcode]\n");
+    prf_hdr(f, "opc calls");
+    for(i = 0; i <= OPM; ++i) {
+        if(prf.opc[i].cnt == 0)
+            continue;
+        if(i == OPM)
+            fprintf(f, "- %lu", prf.opc[i].cnt);
+        else
+            fprintf(f, "%u %lu", i, prf.opc[i].cnt);
+        prf_row(f, prf.opc[i].v);
+    }
+
+    fprintf(f, "\n[block]\n");
+    prf_hdr(f, "bnm cmds");
+    for(i = 0; i < prf.nbk; ++i) {
+        fprintf(f, "%u %u", prf.blk[i].bnm, prf.blk[i].ncm);
+        prf_row(f, prf.blk[i].v);
+    }
+    pthread_mutex_unlock(&prf.mtx);
+
+    fclose(f);
+
+    return (0);
+}
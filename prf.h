@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * prf.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _PRF_H
+#define _PRF_H
+#include <pthread.h>
+#include <stdint.h>
+#include <linux/perf_event.h>
+#include <blk.h>
+#include <opc.h>
+
+/* data tlb load misses */
+#define PRF_DTL (PERF_COUNT_HW_CACHE_DTLB | \
+                 PERF_COUNT_HW_CACHE_OP_READ << 8 | \
+                 PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+/* last level cache load misses */
+#define PRF_LLC (PERF_COUNT_HW_CACHE_LL | \
+                 PERF_COUNT_HW_CACHE_OP_READ << 8 | \
+                 PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+/* counters in report order, wall time in ns follows them in every sample */
+enum {PRC_CYC = 0, PRC_INS, PRC_LLC, PRC_DTL, PRC_BRM, PRN};
+
+/* profiled phases */
+enum {PRP_ADD = 0, PRP_TXN, PRP_CMD, PRP_EXE, PRP_N};
+
+/* a reading of every counter, v[PRN] is the clock */
+struct prv {
+    uint64_t v[PRN + 1];
+};
+
+struct pra {
+    uint64_t cnt;
+    uint64_t v[PRN + 1];
+};
+
+/* one executed block */
+struct prb {
+    uint32_t bnm;
+    uint32_t ncm;
+    uint64_t v[PRN + 1];
+};
+
+/*
+ * profiling mode. each thread opens its own counter group on first use;
+ * counters the kernel refuses (containers, no pmu) are left out of msk
+ * and reported as unavailable, the clock is always there. phases and
+ * opcodes accumulate across threads, executed blocks are kept one row
+ * each until prf_rep writes them to the file given to prf_ini.
+ */
+struct prf {
+    pthread_mutex_t mtx;
+    const char *pth;
+    struct pra phs[PRP_N];
+    struct pra opc[OPM + 1];
+    struct prb *blk;
+    uint32_t nbk;
+    uint32_t cbk;
+    uint32_t msk;
+    int err;
+};
+
+extern uint32_t prf_flg;
+
+static inline uint32_t prf_act(void)
+{
+    return (__atomic_load_n(&prf_flg, __ATOMIC_RELAXED));
+}
+
+int prf_opn(uint32_t typ, uint64_t cfg);
+uint64_t prf_get(int fd);
+void prf_cls(int fd);
+uint32_t prf_ini(const char *path);
+void prf_beg(struct prv *const s);
+void prf_end(uint32_t p, struct prv *const s);
+void prf_opc(uint32_t o, struct prv *const s);
+void prf_blk(const struct blk *const b, uint32_t c, struct prv *const s);
+int prf_rep(void);
+
+#endif
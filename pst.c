@@ -0,0 +1,444 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * pst.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <fcntl.h>
+#include <sched.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <pst.h>
+#include <wir.h>
+#include <utl.h>
+
+static int sys_setup(uint32_t n, struct io_uring_params *r)
+{
+    return (syscall(__NR_io_uring_setup, n, r));
+}
+
+static int sys_enter(int fd, uint32_t s, uint32_t c, uint32_t f)
+{
+    return (syscall(__NR_io_uring_enter, fd, s, c, f, NULL, 0));
+}
+
+static int sys_register(int fd, uint32_t o, void *a, uint32_t n)
+{
+    return (syscall(__NR_io_uring_register, fd, o, a, n));
+}
+
+/* map the rings and register the group buffers, 0 on success */
+static int pst_uring(struct pst *const p)
+{
+    struct io_uring_params r;
+    struct iovec v[PBN];
+    uint32_t i;
+
+    memset(&r, 0, sizeof(r));
+    p->rfd = sys_setup(PBN * 2, &r);
+    if(p->rfd < 0)
+        return (-1);
+
+    p->sqz = r.sq_off.array + r.sq_entries * sizeof(uint32_t);
+    p->cqz = r.cq_off.cqes + r.cq_entries * sizeof(struct io_uring_cqe);
+    if(r.features & IORING_FEAT_SINGLE_MMAP)
+        p->sqz = p->cqz = p->sqz > p->cqz ? p->sqz : p->cqz;
+
+    p->sqp = mmap(NULL, p->sqz, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, p->rfd, IORING_OFF_SQ_RING);
+    if(p->sqp == MAP_FAILED)
+        goto err;
+    if(r.features & IORING_FEAT_SINGLE_MMAP) {
+        p->cqp = p->sqp;
+    } else {
+        p->cqp = mmap(NULL, p->cqz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, p->rfd, IORING_OFF_CQ_RING);
+        if(p->cqp == MAP_FAILED)
+            goto err;
+    }
+    p->sez = r.sq_entries * sizeof(struct io_uring_sqe);
+    p->sqe = mmap(NULL, p->sez, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, p->rfd, IORING_OFF_SQES);
+    if(p->sqe == MAP_FAILED)
+        goto err;
+
+    p->sqh = (uint32_t *)((uint8_t *)p->sqp + r.sq_off.head);
+    p->sqt = (uint32_t *)((uint8_t *)p->sqp + r.sq_off.tail);
+    p->sqm = (uint32_t *)((uint8_t *)p->sqp + r.sq_off.ring_mask);
+    p->sqa = (uint32_t *)((uint8_t *)p->sqp + r.sq_off.array);
+    p->cqh = (uint32_t *)((uint8_t *)p->cqp + r.cq_off.head);
+    p->cqt = (uint32_t *)((uint8_t *)p->cqp + r.cq_off.tail);
+    p->cqm = (uint32_t *)((uint8_t *)p->cqp + r.cq_off.ring_mask);
+    p->cqe = (struct io_uring_cqe *)((uint8_t *)p->cqp + r.cq_off.cqes);
+
+    for(i = 0; i < PBN; ++i) {
+        v[i].iov_base = p->grp[i].buf;
+        v[i].iov_len = PBS;
+    }
+    if(sys_register(p->rfd, IORING_REGISTER_BUFFERS, v, PBN) < 0)
+        goto err;
+
+    return (0);
+
+err:
+    log_wrn("io_uring unavailable, using pwrite");
+    close(p->rfd);
+    p->rfd = -1;
+    return (-1);
+}
+
+static struct io_uring_sqe* pst_sqe(struct pst *const p)
+{
+    struct io_uring_sqe *e;
+    uint32_t t, i;
+
+    t = *p->sqt;
+    i = t & *p->sqm;
+    e = &p->sqe[i];
+    memset(e, 0, sizeof(*e));
+    p->sqa[i] = i;
+
+    return (e);
+}
+
+static void pst_sqa(struct pst *const p, uint32_t n)
+{
+    __atomic_store_n(p->sqt, *p->sqt + n, __ATOMIC_RELEASE);
+}
+
+/* one fixed (or plain, for oversized blocks) write linked to a datasync */
+static void pst_sub(struct pst *const p, struct pgr *const g, uint32_t s)
+{
+    struct io_uring_sqe *e;
+    ssize_t w;
+    int r;
+
+    if(p->rfd < 0) {
+        for(w = 0; w < g->len; w += r) {
+            r = pwrite(p->fd, (g->hbf ? g->hbf : g->buf) + w, g->len - w,
+                       g->off + w);
+            if(r <= 0)
+                break;
+        }
+        g->res = (w == g->len && fdatasync(p->fd) == 0) ? 0 : -EIO;
+        g->dne = 2;
+        p->nfs++;
+        return;
+    }
+
+    e = pst_sqe(p);
+    e->opcode = g->hbf ? IORING_OP_WRITE : IORING_OP_WRITE_FIXED;
+    e->fd = p->fd;
+    e->addr = (uint64_t)(uintptr_t)(g->hbf ? g->hbf : g->buf);
+    e->len = g->len;
+    e->off = g->off;
+    e->buf_index = g->hbf ? 0 : s;
+    e->flags = IOSQE_IO_LINK;
+    e->user_data = s | 1ULL << 32;
+    pst_sqa(p, 1);
+
+    e = pst_sqe(p);
+    e->opcode = IORING_OP_FSYNC;
+    e->fd = p->fd;
+    e->fsync_flags = IORING_FSYNC_DATASYNC;
+    e->user_data = s;
+    pst_sqa(p, 1);
+
+    if(sys_enter(p->rfd, 2, 0, 0) < 0) {
+        log_err("io_uring_enter()");
+        _exit(EXIT_FAILURE);
+    }
+    p->nfs++;
+}
+
+static void pst_rep(struct pst *const p)
+{
+    struct io_uring_cqe *c;
+    struct pgr *g;
+    uint32_t h;
+
+    if(p->rfd < 0)
+        return;
+
+    h = *p->cqh;
+    while(h != __atomic_load_n(p->cqt, __ATOMIC_ACQUIRE)) {
+        c = &p->cqe[h & *p->cqm];
+        g = &p->grp[(uint32_t)c->user_data];
+        if(c->res < 0 && g->res == 0)
+            g->res = c->res;
+        /* a short write fails the group like an error would */
+        if((c->user_data >> 32) && c->res >= 0 && (uint32_t)c->res != g->len &&
+           g->res == 0)
+            g->res = -EIO;
+        g->dne++;
+        h++;
+    }
+    __atomic_store_n(p->cqh, h, __ATOMIC_RELEASE);
+}
+
+/* report finished groups in submission order and recycle their slots */
+static void pst_cmp(struct pst *const p)
+{
+    struct pgr *g;
+    uint32_t i, s;
+
+    while(p->nfl > 0) {
+        for(s = 0; s < PBN; ++s)
+            if(p->grp[s].n > 0 && p->grp[s].seq == p->nxt)
+                break;
+        if(s == PBN)
+            return;
+        g = &p->grp[s];
+        if(g->dne < 2)
+            return;
+        if(g->res < 0) {
+            errno = -g->res;
+            log_err("block log write failed");
+            _exit(EXIT_FAILURE);
+        }
+        for(i = 0; i < g->n; ++i)
+            if(p->cb != NULL)
+                p->cb(g->blk[i], p->a);
+        pthread_mutex_lock(&p->dmx);
+        p->dlb = g->blk[g->n - 1];
+        p->dof = g->off + g->len;
+        __atomic_add_fetch(&p->dur, g->n, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&p->dmx);
+        free(g->hbf);
+        g->hbf = NULL;
+        g->n = 0;
+        p->nxt++;
+        p->nfl--;
+    }
+}
+
+/* fill a free slot with up to gc queued blocks, 0 when nothing was queued */
+static int pst_grp(struct pst *const p)
+{
+    struct pgr *g;
+    struct blk *b;
+    uint32_t s, z;
+
+    for(s = 0; s < PBN; ++s)
+        if(p->grp[s].n == 0)
+            break;
+    if(s == PBN)
+        return (0);
+
+    g = &p->grp[s];
+    g->len = 0;
+    while(g->n < p->gc) {
+        if(p->crr != NULL) {
+            b = p->crr;
+            p->crr = NULL;
+        } else if((b = (struct blk *)rng_get(&p->q)) == NULL) {
+            break;
+        }
+
+        z = wir_siz(b);
+        if(g->n > 0 && (z > PBS || g->len + z > PBS)) {
+            /* does not fit, it opens the next group */
+            p->crr = b;
+            break;
+        }
+        if(z > PBS) {
+            /* oversized block: own group, unregistered buffer */
+            errno = 0;
+            g->hbf = (uint8_t *)malloc(z);
+            if(!valid(g->hbf)) {
+                log_err("!valid(g->hbf)");
+                _exit(EXIT_FAILURE);
+            }
+            g->len = wir_enc(b, g->hbf, z);
+            g->blk[g->n++] = b;
+            break;
+        }
+        g->len += wir_enc(b, g->buf + g->len, PBS - g->len);
+        g->blk[g->n++] = b;
+    }
+
+    if(g->n == 0)
+        return (0);
+
+    g->seq = p->seq++;
+    g->off = p->off;
+    g->res = 0;
+    g->dne = 0;
+    p->off += g->len;
+    p->nfl++;
+    pst_sub(p, g, s);
+
+    return (1);
+}
+
+static void* pst_run(void *a)
+{
+    struct pst *p;
+    struct timespec t;
+    int w;
+
+    p = (struct pst *)a;
+    t.tv_sec = 0;
+    t.tv_nsec = 50000;
+    while(1) {
+        pst_rep(p);
+        pst_cmp(p);
+
+        w = pst_grp(p);
+        if(w)
+            continue;
+
+        if(p->nfl > 0 && p->rfd >= 0) {
+            /* every slot busy or nothing queued, wait for a completion */
+            if(sys_enter(p->rfd, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+               errno != EINTR) {
+                log_err("io_uring_enter()");
+                _exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+
+        if(__atomic_load_n(&p->stp, __ATOMIC_ACQUIRE) && p->nfl == 0 &&
+           p->crr == NULL && __atomic_load_n(&p->dur, __ATOMIC_ACQUIRE) ==
+           __atomic_load_n(&p->sub, __ATOMIC_ACQUIRE))
+            break;
+        nanosleep(&t, NULL);
+    }
+
+    return (NULL);
+}
+
+/* append to the log at path, at most gc blocks share one fdatasync */
+struct pst* pst_new(const char *path, uint32_t gc, dcb_t cb, void *a)
+{
+    struct pst *p;
+    uint32_t i;
+
+    if(path == NULL || gc == 0) {
+        log_err("path == NULL || gc == 0");
+        _exit(EXIT_FAILURE);
+    }
+
+    errno = 0;
+    p = (struct pst *)calloc(1, sizeof(struct pst));
+    if(!valid(p)) {
+        log_err("!valid(p)");
+        _exit(EXIT_FAILURE);
+    }
+
+    errno = 0;
+    p->fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if(p->fd < 0) {
+        log_err("open()");
+        _exit(EXIT_FAILURE);
+    }
+    /* no O_APPEND: groups in flight land at their own offsets, in order */
+    p->off = lseek(p->fd, 0, SEEK_END);
+    p->dof = p->off;
+    pthread_mutex_init(&p->dmx, NULL);
+
+    for(i = 0; i < PBN; ++i) {
+        p->grp[i].buf = (uint8_t *)mmap(NULL, PBS, PROT_READ | PROT_WRITE,
+                                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(p->grp[i].buf == MAP_FAILED) {
+            log_err("mmap()");
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    rng_ini(&p->q, PQL);
+    p->gc = gc > PGM ? PGM : gc;
+    p->cb = cb;
+    p->a = a;
+    pst_uring(p);
+
+    errno = pthread_create(&p->thr, NULL, pst_run, p);
+    if(errno != 0) {
+        log_err("pthread_create()");
+        _exit(EXIT_FAILURE);
+    }
+
+    return (p);
+}
+
+/*
+ * queue b for the log without touching storage. b must be sealed and not
+ * change until it is reported durable. 0 when the queue is full.
+ */
+int pst_put(struct pst *const p, struct blk *const b)
+{
+    if(!valid(p) || !valid(b)) {
+        log_err("!valid(p) || !valid(b)");
+        _exit(EXIT_FAILURE);
+    }
+
+    if(!rng_put(&p->q, b)) {
+        __atomic_add_fetch(&p->drp, 1, __ATOMIC_RELAXED);
+        return (0);
+    }
+    __atomic_add_fetch(&p->sub, 1, __ATOMIC_RELEASE);
+
+    return (1);
+}
+
+/* wait until every queued block is durable */
+void pst_drn(struct pst *const p)
+{
+    struct timespec t;
+
+    t.tv_sec = 0;
+    t.tv_nsec = 100000;
+    while(__atomic_load_n(&p->dur, __ATOMIC_ACQUIRE) !=
+          __atomic_load_n(&p->sub, __ATOMIC_ACQUIRE))
+        nanosleep(&t, NULL);
+}
+
+uint64_t pst_dur(struct pst *const p)
+{
+    return (__atomic_load_n(&p->dur, __ATOMIC_ACQUIRE));
+}
+
+/*
+ * the last durable block into b, NULL before the first, and the log
+ * offset right after its record, where replay of later blocks starts
+ */
+uint64_t pst_pos(struct pst *const p, struct blk **const b)
+{
+    uint64_t o;
+
+    pthread_mutex_lock(&p->dmx);
+    *b = p->dlb;
+    o = p->dof;
+    pthread_mutex_unlock(&p->dmx);
+
+    return (o);
+}
+
+void pst_del(struct pst *const p)
+{
+    uint32_t i;
+
+    if(!valid(p))
+        return;
+
+    __atomic_store_n(&p->stp, 1, __ATOMIC_RELEASE);
+    pthread_join(p->thr, NULL);
+
+    if(p->rfd >= 0) {
+        munmap(p->sqe, p->sez);
+        if(p->cqp != p->sqp)
+            munmap(p->cqp, p->cqz);
+        munmap(p->sqp, p->sqz);
+        close(p->rfd);
+    }
+    for(i = 0; i < PBN; ++i)
+        munmap(p->grp[i].buf, PBS);
+    rng_fre(&p->q);
+    pthread_mutex_destroy(&p->dmx);
+    close(p->fd);
+    free(p);
+}
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * pst.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _PST_H
+#define _PST_H
+#include <pthread.h>
+#include <stdint.h>
+#include <blk.h>
+#include <rng.h>
+
+/* registered buffers, one per group commit in flight */
+#define PBN     16
+#define PBS     (1U << 20)
+/* most blocks per group commit */
+#define PGM     64
+#define PQL     4096
+
+typedef void (*dcb_t)(struct blk *const b, void *a);
+
+struct pgr {
+    struct blk *blk[PGM];
+    uint8_t *buf;
+    uint8_t *hbf;
+    uint64_t seq;
+    uint64_t off;
+    uint32_t len;
+    uint32_t n;
+    uint32_t dne;
+    int32_t res;
+};
+
+/*
+ * asynchronous block log. pst_put only queues the block, a persistence
+ * thread encodes queued blocks (wir.h) into registered buffers, writes up to
+ * gc of them with one fixed write and one linked fdatasync, and reports
+ * each block durable through cb in submission order. without io_uring
+ * the same thread falls back to pwrite and fdatasync.
+ */
+struct pst {
+    struct rng q;
+    struct pgr grp[PBN];
+    struct blk *crr;
+    pthread_t thr;
+    dcb_t cb;
+    void *a;
+    int fd;
+    int rfd;
+    uint32_t gc;
+    uint32_t stp;
+    uint32_t nfl;
+    uint32_t *sqh;
+    uint32_t *sqt;
+    uint32_t *sqm;
+    uint32_t *sqa;
+    uint32_t *cqh;
+    uint32_t *cqt;
+    uint32_t *cqm;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    void *sqp;
+    void *cqp;
+    size_t sqz;
+    size_t cqz;
+    size_t sez;
+    uint64_t off;
+    uint64_t seq;
+    uint64_t nxt;
+    uint64_t sub;
+    uint64_t dur;
+    uint64_t drp;
+    uint64_t nfs;
+    pthread_mutex_t dmx;
+    struct blk *dlb;
+    uint64_t dof;
+};
+
+struct pst* pst_new(const char *path, uint32_t gc, dcb_t cb, void *a);
+int pst_put(struct pst *const p, struct blk *const b);
+void pst_drn(struct pst *const p);
+uint64_t pst_dur(struct pst *const p);
+uint64_t pst_pos(struct pst *const p, struct blk **const b);
+void pst_del(struct pst *const p);
+
+#endif
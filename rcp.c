@@ -0,0 +1,358 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * rcp.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <rcp.h>
+#include <sha.h>
+#include <utl.h>
+#include <vec.h>
+
+__thread struct rcx rcx;
+
+/*
+ * receipts by height, one list per height with an entry per block that
+ * executed there. scans resolve a height to its canonical block.
+ */
+static struct vec rdr = VEC_INIT;
+static pthread_mutex_t rmx = PTHREAD_MUTEX_INITIALIZER;
+
+static void* rcp_grw(void *p, size_t n)
+{
+    errno = 0;
+    p = realloc(p, n);
+    if(!valid(p)) {
+        log_err("!valid(p)");
+        _exit(EXIT_FAILURE);
+    }
+
+    return (p);
+}
+
+static inline uint32_t rcp_bit(uint64_t k)
+{
+    return ((k * 0x9e3779b97f4a7c15ULL) >> 56);
+}
+
+/* log key k for the running txn */
+void rcp_log(uint64_t k)
+{
+    struct rcs *r;
+    uint32_t h;
+
+    r = rcx.r;
+    if(r == NULL || rcx.i >= r->n)
+        return;
+
+    pthread_mutex_lock(&r->mtx);
+    if(r->nlg == r->mlg) {
+        r->mlg = r->mlg ? r->mlg * 2 : 64;
+        r->lgt = (uint32_t *)rcp_grw(r->lgt, sizeof(uint32_t) * r->mlg);
+        r->lgk = (uint64_t *)rcp_grw(r->lgk, sizeof(uint64_t) * r->mlg);
+    }
+    r->lgt[r->nlg] = rcx.i;
+    r->lgk[r->nlg++] = k;
+    h = rcp_bit(k);
+    r->blm[h >> 6] |= 1ULL << (h & 63);
+    pthread_mutex_unlock(&r->mtx);
+}
+
+/* receipts of b, NULL when it never executed */
+static struct rcs* rcp_fnd(const struct blk *const b)
+{
+    struct rcs *r;
+
+    if(b->bnm >= vec_len(&rdr))
+        return (NULL);
+    r = (struct rcs *)vec_get(&rdr, b->bnm);
+    while(r != NULL && r->b != b)
+        r = r->nxt;
+
+    return (r);
+}
+
+/* add r, complete, to the list of its height; rmx is held */
+static void rcp_lnk(struct rcs *const r)
+{
+    while(vec_len(&rdr) <= r->b->bnm)
+        vec_add(&rdr, NULL);
+    r->nxt = (struct rcs *)vec_get(&rdr, r->b->bnm);
+    vec_put(&rdr, r->b->bnm, r);
+}
+
+/* clear the receipts of b before its commands run */
+void rcp_beg(struct blk *const b)
+{
+    struct rcs *r;
+
+    if(b->tdx == 0)
+        return;
+
+    pthread_mutex_lock(&rmx);
+    r = rcp_fnd(b);
+    if(r == NULL) {
+        errno = 0;
+        r = (struct rcs *)malloc(sizeof(struct rcs));
+        if(!valid(r)) {
+            log_err("!valid(r)");
+            _exit(EXIT_FAILURE);
+        }
+        memset(r, 0, sizeof(struct rcs));
+        pthread_mutex_init(&r->mtx, NULL);
+        r->b = b;
+        rcp_lnk(r);
+    }
+    pthread_mutex_unlock(&rmx);
+
+    /* columns borrowed from a checkpoint are never grown in place */
+    if(r->m == 0) {
+        r->sta = NULL;
+        r->gsu = NULL;
+    }
+    if(r->mlg == 0) {
+        r->lgt = NULL;
+        r->lgk = NULL;
+    }
+    if(r->m < b->tdx) {
+        r->m = b->tdx;
+        r->sta = (uint16_t *)rcp_grw(r->sta, sizeof(uint16_t) * r->m);
+        r->gsu = (uint32_t *)rcp_grw(r->gsu, sizeof(uint32_t) * r->m);
+    }
+    r->n = b->tdx;
+    r->nlg = 0;
+    r->gas = 0;
+    r->nfl = 0;
+    memset(r->blm, 0, sizeof(r->blm));
+    memset(r->sta, 0, sizeof(uint16_t) * r->n);
+    memset(r->gsu, 0, sizeof(uint32_t) * r->n);
+    blk_bcd(b)->rcs = r;
+}
+
+struct rlg {
+    uint64_t k;
+    uint32_t t;
+};
+
+static int rlg_cmp(const void *a, const void *b)
+{
+    const struct rlg *x, *y;
+
+    x = (const struct rlg *)a;
+    y = (const struct rlg *)b;
+    if(x->t != y->t)
+        return (x->t < y->t ? -1 : 1);
+
+    return (x->k < y->k ? -1 : x->k > y->k);
+}
+
+/* parallel commands log in any order, sort by txn then key */
+static void rcp_srt(struct rcs *const r)
+{
+    struct rlg *l;
+    uint32_t i;
+
+    if(r->nlg < 2)
+        return;
+
+    errno = 0;
+    l = (struct rlg *)malloc(sizeof(struct rlg) * r->nlg);
+    if(!valid(l)) {
+        log_err("!valid(l)");
+        _exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < r->nlg; ++i) {
+        l[i].t = r->lgt[i];
+        l[i].k = r->lgk[i];
+    }
+    qsort(l, r->nlg, sizeof(struct rlg), rlg_cmp);
+    for(i = 0; i < r->nlg; ++i) {
+        r->lgt[i] = l[i].t;
+        r->lgk[i] = l[i].k;
+    }
+    free(l);
+}
+
+/*
+ * after the commands of b ran: sort the logs, fold the summaries, copy
+ * status and gas into the txns and hash the columns into rrh. a block
+ * without txns has an all zero rrh.
+ */
+void rcp_fin(struct blk *const b)
+{
+    struct rcs *r;
+    struct sha s;
+    uint64_t g;
+    uint32_t i, f;
+
+    if(b->tdx == 0)
+        return;
+
+    r = blk_bcd(b)->rcs;
+    if(r == NULL || r->b != b) {
+        log_err("block %u has no receipts", b->bnm);
+        _exit(EXIT_FAILURE);
+    }
+
+    rcp_srt(r);
+    for(i = 0, g = 0, f = 0; i < r->n; ++i) {
+        g += r->gsu[i];
+        f += r->sta[i] != 0;
+    }
+    r->gas = g;
+    r->nfl = f;
+    for(i = 0; i < r->n; ++i) {
+        b->tta[i].sta = r->sta[i];
+        b->tta[i].gsu = r->gsu[i];
+    }
+
+    sha_ini(&s);
+    sha_upd(&s, &r->n, sizeof(r->n));
+    sha_upd(&s, r->sta, sizeof(uint16_t) * r->n);
+    sha_upd(&s, r->gsu, sizeof(uint32_t) * r->n);
+    sha_upd(&s, &r->nlg, sizeof(r->nlg));
+    sha_upd(&s, r->lgt, sizeof(uint32_t) * r->nlg);
+    sha_upd(&s, r->lgk, sizeof(uint64_t) * r->nlg);
+    sha_fin(&s, b->bcd->rrh);
+}
+
+/*
+ * install receipts of b that executed before a restart. s holds the
+ * summaries and columns, which stay borrowed: m and mlg are 0 until b
+ * runs again and rcp_beg gives it columns of its own.
+ */
+void rcp_map(struct blk *const b, const struct rcs *const s)
+{
+    struct rcs *r;
+
+    if(!valid(b) || s == NULL || s->n != b->tdx) {
+        log_err("receipts do not match block");
+        _exit(EXIT_FAILURE);
+    }
+
+    errno = 0;
+    r = (struct rcs *)malloc(sizeof(struct rcs));
+    if(!valid(r)) {
+        log_err("!valid(r)");
+        _exit(EXIT_FAILURE);
+    }
+    *r = *s;
+    pthread_mutex_init(&r->mtx, NULL);
+    r->b = b;
+    r->m = 0;
+    r->mlg = 0;
+
+    pthread_mutex_lock(&rmx);
+    if(rcp_fnd(b) != NULL) {
+        pthread_mutex_unlock(&rmx);
+        log_err("block %u already has receipts", b->bnm);
+        _exit(EXIT_FAILURE);
+    }
+    rcp_lnk(r);
+    pthread_mutex_unlock(&rmx);
+}
+
+/* receipts of canonical block n, NULL until it executed */
+struct rcs* rcp_get(uint32_t n)
+{
+    struct blk *b;
+
+    b = blk_get(n);
+
+    return (b != NULL ? rcp_fnd(b) : NULL);
+}
+
+static uint32_t rfx_put(struct rfx *o, uint32_t c, uint32_t m,
+                        const struct rcs *const r, uint32_t i)
+{
+    if(c < m) {
+        o[c].bnm = r->b->bnm;
+        o[c].idx = i;
+        o[c].sta = r->sta[i];
+    }
+
+    return (c + 1);
+}
+
+/*
+ * failed txns of blocks [f, t) into o, up to m, returns how many there
+ * are. blocks without failures are skipped on their count, the status
+ * column is tested four entries a word.
+ */
+uint32_t rcp_fld(uint32_t f, uint32_t t, struct rfx *o, uint32_t m)
+{
+    struct rcs *r;
+    uint64_t w;
+    uint32_t i, j, k, c;
+
+    if(!valid(o) && m > 0) {
+        log_err("!valid(o)");
+        _exit(EXIT_FAILURE);
+    }
+
+    c = 0;
+    for(i = f; i < t; ++i) {
+        r = rcp_get(i);
+        if(r == NULL || r->nfl == 0)
+            continue;
+        for(j = 0; j + 4 <= r->n; j += 4) {
+            memcpy(&w, r->sta + j, sizeof(w));
+            if(w == 0)
+                continue;
+            for(k = j; k < j + 4; ++k)
+                if(r->sta[k] != 0)
+                    c = rfx_put(o, c, m, r, k);
+        }
+        for(; j < r->n; ++j)
+            if(r->sta[j] != 0)
+                c = rfx_put(o, c, m, r, j);
+    }
+
+    return (c);
+}
+
+/* gas used by each block of [f, t) into o[0 .. t-f) */
+void rcp_gsm(uint32_t f, uint32_t t, uint64_t *const o)
+{
+    struct rcs *r;
+    uint32_t i;
+
+    if(!valid(o)) {
+        log_err("!valid(o)");
+        _exit(EXIT_FAILURE);
+    }
+
+    for(i = f; i < t; ++i) {
+        r = rcp_get(i);
+        o[i - f] = r != NULL ? r->gas : 0;
+    }
+}
+
+/* txns of blocks [f, t) that logged k, blocks are skipped on their bloom */
+uint32_t rcp_lgf(uint32_t f, uint32_t t, uint64_t k, struct rfx *o,
+                 uint32_t m)
+{
+    struct rcs *r;
+    uint32_t i, j, h, c;
+
+    if(!valid(o) && m > 0) {
+        log_err("!valid(o)");
+        _exit(EXIT_FAILURE);
+    }
+
+    h = rcp_bit(k);
+    c = 0;
+    for(i = f; i < t; ++i) {
+        r = rcp_get(i);
+        if(r == NULL || !(r->blm[h >> 6] & (1ULL << (h & 63))))
+            continue;
+        for(j = 0; j < r->nlg; ++j)
+            if(r->lgk[j] == k && (j == 0 || r->lgt[j] != r->lgt[j - 1] ||
+                                  r->lgk[j - 1] != k))
+                c = rfx_put(o, c, m, r, r->lgt[j]);
+    }
+
+    return (c);
+}
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * rcp.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _RCP_H
+#define _RCP_H
+#include <pthread.h>
+#include <stdint.h>
+#include <blk.h>
+
+/* log bloom words per block */
+#define RBW     4
+
+/*
+ * execution receipts of one block, one column per field so scans read
+ * only the field they test. sta and gsu are indexed by txn, logs are
+ * (txn, key) pairs sorted at the end of execution. gas, nfl and blm
+ * summarize the columns so scans can skip whole blocks. receipts belong
+ * to block b; nxt links the receipts of other blocks at its height.
+ */
+struct rcs {
+    pthread_mutex_t mtx;
+    struct blk *b;
+    struct rcs *nxt;
+    uint16_t *sta;
+    uint32_t *gsu;
+    uint32_t *lgt;
+    uint64_t *lgk;
+    uint64_t gas;
+    uint64_t blm[RBW];
+    uint32_t n;
+    uint32_t m;
+    uint32_t nlg;
+    uint32_t mlg;
+    uint32_t nfl;
+};
+
+/* a txn found by a scan */
+struct rfx {
+    uint32_t bnm;
+    uint32_t idx;
+    uint16_t sta;
+};
+
+/* receipts and txn of the command running on this thread */
+struct rcx {
+    struct rcs *r;
+    uint32_t i;
+};
+
+extern __thread struct rcx rcx;
+
+static inline void rcp_set(struct blk *const b, uint32_t i)
+{
+    rcx.r = b->bcd != NULL ? b->bcd->rcs : NULL;
+    rcx.i = i;
+}
+
+/*
+ * fail the running txn with status s. commands of one txn may run in
+ * parallel, so the highest status of its failures is kept whatever
+ * order they finished in, and rrh stays the same on every executor.
+ */
+static inline void rcp_fal(uint16_t s)
+{
+    uint16_t *p, o;
+
+    if(rcx.r == NULL || rcx.i >= rcx.r->n)
+        return;
+
+    p = &rcx.r->sta[rcx.i];
+    o = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while(o < s && !__atomic_compare_exchange_n(p, &o, s, 0, __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED))
+        ;
+}
+
+/* charge g gas to the running txn */
+static inline void rcp_gas(uint32_t g)
+{
+    if(rcx.r != NULL && rcx.i < rcx.r->n)
+        __atomic_add_fetch(&rcx.r->gsu[rcx.i], g, __ATOMIC_RELAXED);
+}
+
+void rcp_log(uint64_t k);
+void rcp_beg(struct blk *const b);
+void rcp_fin(struct blk *const b);
+void rcp_map(struct blk *const b, const struct rcs *const s);
+struct rcs* rcp_get(uint32_t n);
+uint32_t rcp_fld(uint32_t f, uint32_t t, struct rfx *o, uint32_t m);
+void rcp_gsm(uint32_t f, uint32_t t, uint64_t *const o);
+uint32_t rcp_lgf(uint32_t f, uint32_t t, uint64_t k, struct rfx *o,
+                 uint32_t m);
+
+#endif
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * rng.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <unistd.h>
+#include <rng.h>
+#include <utl.h>
+
+/* n is rounded up to a power of two */
+void rng_ini(struct rng *const r, uint32_t n)
+{
+    uint64_t s, i;
+
+    if(r == NULL || n == 0) {
+        log_err("r == NULL || n == 0");
+        _exit(EXIT_FAILURE);
+    }
+
+    for(s = 2; s < n; s <<= 1)
+        ;
+    errno = 0;
+    r->cel = (struct rnc *)malloc(sizeof(struct rnc) * s);
+    if(!valid(r->cel)) {
+        log_err("!valid(r->cel)");
+        _exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < s; ++i)
+        r->cel[i].seq = i;
+    r->msk = s - 1;
+    r->hd = 0;
+    r->tl = 0;
+}
+
+void rng_fre(struct rng *const r)
+{
+    if(r == NULL)
+        return;
+
+    free(r->cel);
+    r->cel = NULL;
+}
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * rng.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _RNG_H
+#define _RNG_H
+#include <stdint.h>
+
+/*
+ * bounded lock-free multi producer multi consumer ring. each cell carries
+ * a sequence number that tells producers and consumers whose turn it is.
+ */
+struct rnc {
+    uint64_t seq;
+    void *p;
+};
+
+struct rng {
+    struct rnc *cel;
+    uint64_t msk;
+    uint64_t hd __attribute__((aligned(64)));
+    uint64_t tl __attribute__((aligned(64)));
+};
+
+void rng_ini(struct rng *const r, uint32_t n);
+void rng_fre(struct rng *const r);
+
+/* returns 0 when the ring is full */
+static inline int rng_put(struct rng *const r, void *const p)
+{
+    struct rnc *c;
+    uint64_t t, s;
+
+    t = __atomic_load_n(&r->tl, __ATOMIC_RELAXED);
+    while(1) {
+        c = &r->cel[t & r->msk];
+        s = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+        if(s == t) {
+            if(__atomic_compare_exchange_n(&r->tl, &t, t + 1, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if((int64_t)(s - t) < 0) {
+            return (0);
+        } else {
+            t = __atomic_load_n(&r->tl, __ATOMIC_RELAXED);
+        }
+    }
+    c->p = p;
+    __atomic_store_n(&c->seq, t + 1, __ATOMIC_RELEASE);
+
+    return (1);
+}
+
+/* returns NULL when the ring is empty */
+static inline void* rng_get(struct rng *const r)
+{
+    struct rnc *c;
+    uint64_t h, s;
+    void *p;
+
+    h = __atomic_load_n(&r->hd, __ATOMIC_RELAXED);
+    while(1) {
+        c = &r->cel[h & r->msk];
+        s = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+        if(s == h + 1) {
+            if(__atomic_compare_exchange_n(&r->hd, &h, h + 1, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if((int64_t)(s - (h + 1)) < 0) {
+            return (NULL);
+        } else {
+            h = __atomic_load_n(&r->hd, __ATOMIC_RELAXED);
+        }
+    }
+    p = c->p;
+    __atomic_store_n(&c->seq, h + r->msk + 1, __ATOMIC_RELEASE);
+
+    return (p);
+}
+
+#endif
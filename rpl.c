@@ -0,0 +1,605 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * rpl.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <rpl.h>
+#include <utl.h>
+
+static void rmp_ini(struct rmp *const m, uint32_t n)
+{
+    errno = 0;
+    m->key = (uint64_t *)calloc(n, sizeof(uint64_t));
+    m->val = (void **)calloc(n, sizeof(void *));
+    if(!valid(m->key) || !valid(m->val)) {
+        log_err("!valid(m->key) || !valid(m->val)");
+        _exit(EXIT_FAILURE);
+    }
+    m->msk = n - 1;
+    m->cnt = 0;
+}
+
+static void rmp_fre(struct rmp *const m)
+{
+    free(m->key);
+    free(m->val);
+    m->key = NULL;
+    m->val = NULL;
+}
+
+static uint32_t rmp_slt(const struct rmp *const m, uint64_t k)
+{
+    uint32_t h;
+
+    h = (uint32_t)((k * 0x9e3779b97f4a7c15ULL) >> 32) & m->msk;
+    while(m->key[h] != 0 && m->key[h] != k)
+        h = (h + 1) & m->msk;
+
+    return (h);
+}
+
+static void* rmp_get(const struct rmp *const m, uint64_t k)
+{
+    uint32_t h;
+
+    h = rmp_slt(m, k);
+
+    return (m->key[h] == k ? m->val[h] : NULL);
+}
+
+static void rmp_put(struct rmp *const m, uint64_t k, void *v)
+{
+    struct rmp n;
+    uint32_t h, i;
+
+    if((m->cnt + 1) * 2 > m->msk + 1) {
+        rmp_ini(&n, (m->msk + 1) * 2);
+        for(i = 0; i <= m->msk; ++i) {
+            if(m->key[i] == 0)
+                continue;
+            h = rmp_slt(&n, m->key[i]);
+            n.key[h] = m->key[i];
+            n.val[h] = m->val[i];
+            n.cnt++;
+        }
+        rmp_fre(m);
+        *m = n;
+    }
+
+    h = rmp_slt(m, k);
+    if(m->key[h] == 0)
+        m->cnt++;
+    m->key[h] = k;
+    m->val[h] = v;
+}
+
+/* remove k, shifting later entries of its probe run back into the hole */
+static void rmp_del(struct rmp *const m, uint64_t k)
+{
+    uint32_t h, i, d;
+
+    h = rmp_slt(m, k);
+    if(m->key[h] != k)
+        return;
+
+    m->key[h] = 0;
+    m->cnt--;
+    for(i = (h + 1) & m->msk; m->key[i] != 0; i = (i + 1) & m->msk) {
+        d = (uint32_t)((m->key[i] * 0x9e3779b97f4a7c15ULL) >> 32) & m->msk;
+        if(((i - d) & m->msk) >= ((i - h) & m->msk)) {
+            m->key[h] = m->key[i];
+            m->val[h] = m->val[i];
+            m->key[i] = 0;
+            h = i;
+        }
+    }
+}
+
+static uint64_t rpl_sid(const uint8_t h[BFL])
+{
+    uint64_t s;
+
+    memcpy(&s, h, sizeof(s));
+
+    return (s ? s : 1);
+}
+
+/* largest payload a frame of type t can carry under the block caps */
+static uint64_t rpl_max(uint32_t t)
+{
+    uint64_t x;
+
+    x = sizeof(struct wtx) + (uint64_t)sizeof(struct wcm) * bcp.cpt;
+    if(t == RTX)
+        return (x);
+    if(t == RBK)
+        return (sizeof(struct wbh) + (sizeof(struct rce) + x) * bcp.tpb);
+
+    return (0);
+}
+
+/* scratch buffer of at least n bytes, 8 byte aligned */
+static uint8_t* rpl_buf(struct rpl *const r, uint32_t n)
+{
+    if(n > r->cap) {
+        free(r->buf);
+        r->cap = n > r->cap * 2 ? n : r->cap * 2;
+        errno = 0;
+        r->buf = (uint8_t *)aligned_alloc(WAL, WAL_UP(r->cap));
+        if(!valid(r->buf)) {
+            log_err("!valid(r->buf)");
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    return (r->buf);
+}
+
+/* send n iovecs with as few sendmsg calls as RIV allows, -1 on error */
+static int rpl_snd(int fd, struct iovec *v, uint32_t n)
+{
+    struct msghdr m;
+    ssize_t w;
+    uint32_t c;
+
+    while(n > 0) {
+        memset(&m, 0, sizeof(m));
+        c = n > RIV ? RIV : n;
+        m.msg_iov = v;
+        m.msg_iovlen = c;
+        w = sendmsg(fd, &m, MSG_NOSIGNAL);
+        if(w < 0) {
+            if(errno == EINTR)
+                continue;
+            return (-1);
+        }
+        /* skip what was written, resume a partial iovec */
+        while(n > 0 && (size_t)w >= v->iov_len) {
+            w -= v->iov_len;
+            v++;
+            n--;
+        }
+        if(n > 0 && w > 0) {
+            v->iov_base = (uint8_t *)v->iov_base + w;
+            v->iov_len -= w;
+        }
+    }
+
+    return (0);
+}
+
+static int rpl_rdn(int fd, void *p, size_t n)
+{
+    ssize_t r;
+    size_t d;
+
+    for(d = 0; d < n; d += r) {
+        r = read(fd, (uint8_t *)p + d, n - d);
+        if(r < 0 && errno == EINTR) {
+            r = 0;
+            continue;
+        }
+        if(r <= 0)
+            return (r == 0 && d == 0 ? 0 : -1);
+    }
+
+    return (1);
+}
+
+static void rpl_drp(struct rpl *const r, uint32_t i)
+{
+    log_wrn("follower %u dropped", i);
+    close(r->fd[i]);
+    rmp_fre(&r->knw[i]);
+    r->nfd--;
+    r->fd[i] = r->fd[r->nfd];
+    r->knw[i] = r->knw[r->nfd];
+}
+
+static struct rpl* rpl_new(void)
+{
+    struct rpl *r;
+
+    errno = 0;
+    r = (struct rpl *)calloc(1, sizeof(struct rpl));
+    if(!valid(r)) {
+        log_err("!valid(r)");
+        _exit(EXIT_FAILURE);
+    }
+    r->lfd = -1;
+
+    return (r);
+}
+
+static void rpl_adr(struct sockaddr_un *const a, const char *path)
+{
+    memset(a, 0, sizeof(*a));
+    a->sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(a->sun_path)) {
+        log_err("socket path too long");
+        _exit(EXIT_FAILURE);
+    }
+    strcpy(a->sun_path, path);
+}
+
+/* leader side, followers connect to the unix socket at path */
+struct rpl* rpl_ldr(const char *path)
+{
+    struct sockaddr_un a;
+    struct rpl *r;
+
+    r = rpl_new();
+    rpl_adr(&a, path);
+    unlink(path);
+
+    errno = 0;
+    r->lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(r->lfd < 0 || bind(r->lfd, (struct sockaddr *)&a, sizeof(a)) < 0 ||
+       listen(r->lfd, RFM) < 0) {
+        log_err("listen on %s", path);
+        _exit(EXIT_FAILURE);
+    }
+
+    return (r);
+}
+
+/* accept pending followers without blocking */
+void rpl_acc(struct rpl *const r)
+{
+    struct timeval t;
+    int fd;
+
+    /* a follower that stalls a send for RTO is dropped, not waited on */
+    t.tv_sec = RTO / 1000;
+    t.tv_usec = (RTO % 1000) * 1000;
+    while(r->nfd < RFM) {
+        fd = accept(r->lfd, NULL, NULL);
+        if(fd < 0)
+            return;
+        if(setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &t, sizeof(t)) < 0) {
+            log_wrn("follower send timeout");
+            close(fd);
+            continue;
+        }
+        r->fd[r->nfd] = fd;
+        rmp_ini(&r->knw[r->nfd], 1024);
+        r->nfd++;
+    }
+}
+
+/* announce x to followers that have not seen it yet */
+void rpl_txn(struct rpl *const r, struct txn *const x)
+{
+    struct iovec v[2];
+    struct rph h;
+    uint64_t s;
+    uint32_t i, n;
+    uint8_t *o;
+
+    if(!valid(r) || !valid(x)) {
+        log_err("!valid(r) || !valid(x)");
+        _exit(EXIT_FAILURE);
+    }
+
+    n = wir_tsz(x);
+    o = rpl_buf(r, n);
+    wir_etx(x, o);
+    s = rpl_sid(x->hsh);
+
+    h.typ = RTX;
+    h.len = n;
+    h.tsm = tsm_get();
+    for(i = 0; i < r->nfd; ++i) {
+        if(rmp_get(&r->knw[i], s) != NULL)
+            continue;
+        v[0].iov_base = &h;
+        v[0].iov_len = sizeof(h);
+        v[1].iov_base = o;
+        v[1].iov_len = n;
+        if(rpl_snd(r->fd[i], v, 2) < 0) {
+            rpl_drp(r, i--);
+            continue;
+        }
+        rmp_put(&r->knw[i], s, (void *)1);
+        r->sts.txn++;
+    }
+}
+
+/*
+ * relay b as a header plus one short id per txn. txns a follower was
+ * announced travel as ids, the rest inline; runs of inline records that
+ * are adjacent in the scratch buffer share one iovec.
+ */
+void rpl_blk(struct rpl *const r, struct blk *const b)
+{
+    struct iovec *v;
+    struct rce *e;
+    struct wbh w;
+    struct rph h;
+    uint32_t *off, i, j, n, nv, p;
+    uint64_t s;
+    uint8_t *o;
+
+    if(!valid(r) || !valid(b)) {
+        log_err("!valid(r) || !valid(b)");
+        _exit(EXIT_FAILURE);
+    }
+
+    rpl_acc(r);
+    blk_pin(b);
+
+    /* every txn record once, followers pick what they lack */
+    for(i = 0, n = 0; i < b->tdx; ++i)
+        n += wir_tsz(&b->tta[i]);
+    o = rpl_buf(r, n + sizeof(uint32_t) * (b->tdx + 1));
+    off = (uint32_t *)(o + n);
+    for(i = 0, p = 0; i < b->tdx; ++i) {
+        off[i] = p;
+        p += wir_etx(&b->tta[i], o + p);
+    }
+    off[b->tdx] = p;
+
+    errno = 0;
+    e = (struct rce *)malloc(sizeof(struct rce) * (b->tdx + 1));
+    v = (struct iovec *)malloc(sizeof(struct iovec) * (b->tdx + 4));
+    if(!valid(e) || !valid(v)) {
+        log_err("!valid(e) || !valid(v)");
+        _exit(EXIT_FAILURE);
+    }
+
+    wir_ehd(b, &w, wir_siz(b));
+    h.typ = RBK;
+    for(i = 0; i < r->nfd; ++i) {
+        nv = 3;
+        p = sizeof(struct wbh) + sizeof(struct rce) * b->tdx;
+        for(j = 0; j < b->tdx; ++j) {
+            s = rpl_sid(b->tta[j].hsh);
+            e[j].sid = htole64(s);
+            if(rmp_get(&r->knw[i], s) != NULL) {
+                e[j].off = 0;
+                e[j].len = 0;
+                rmp_del(&r->knw[i], s);
+                continue;
+            }
+            e[j].off = htole32(p);
+            e[j].len = htole32(off[j+1] - off[j]);
+            p += off[j+1] - off[j];
+            if(nv > 3 && (uint8_t *)v[nv-1].iov_base + v[nv-1].iov_len ==
+               o + off[j]) {
+                v[nv-1].iov_len += off[j+1] - off[j];
+            } else {
+                v[nv].iov_base = o + off[j];
+                v[nv++].iov_len = off[j+1] - off[j];
+            }
+            r->sts.inl++;
+        }
+
+        h.len = p;
+        h.tsm = tsm_get();
+        v[0].iov_base = &h;
+        v[0].iov_len = sizeof(h);
+        v[1].iov_base = &w;
+        v[1].iov_len = sizeof(w);
+        v[2].iov_base = e;
+        v[2].iov_len = sizeof(struct rce) * b->tdx;
+        if(rpl_snd(r->fd[i], v, nv) < 0) {
+            rpl_drp(r, i--);
+            continue;
+        }
+        r->sts.byt += sizeof(h) + p;
+        r->sts.ful += sizeof(h) + wle32(w.len);
+    }
+    r->sts.blk++;
+
+    free(e);
+    free(v);
+    blk_rel(b);
+}
+
+/* follower side */
+struct rpl* rpl_fol(const char *path)
+{
+    struct sockaddr_un a;
+    struct rpl *r;
+
+    r = rpl_new();
+    rpl_adr(&a, path);
+    rmp_ini(&r->pol, 1024);
+
+    errno = 0;
+    r->fd[0] = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(r->fd[0] < 0 || connect(r->fd[0], (struct sockaddr *)&a, sizeof(a)) < 0) {
+        log_err("connect to %s", path);
+        _exit(EXIT_FAILURE);
+    }
+    r->nfd = 1;
+
+    return (r);
+}
+
+/*
+ * rebuild the full record of a compact block in p, NULL on a pool miss
+ * or when its txns do not hash to the root the leader sent
+ */
+static struct blk* rpl_bld(struct rpl *const r, const uint8_t *p, uint32_t n)
+{
+    const struct wbh *w, *h;
+    const struct rce *e;
+    struct blk *b, *l;
+    uint8_t *o, *t, c[BFL];
+    uint32_t *off, d, i, q;
+    uint64_t z, f;
+
+    if(n < sizeof(struct wbh))
+        return (NULL);
+    w = (const struct wbh *)p;
+    d = wle32(w->tdx);
+    if(d >= bcp.tpb || sizeof(struct wbh) + (uint64_t)sizeof(struct rce) * d > n)
+        return (NULL);
+    e = (const struct rce *)(w + 1);
+
+    /* inline records follow the entries, in order and disjoint */
+    z = sizeof(struct wbh) + WAL_UP(sizeof(uint32_t) * d);
+    f = sizeof(struct wbh) + (uint64_t)sizeof(struct rce) * d;
+    for(i = 0; i < d; ++i) {
+        if(wle32(e[i].len) == 0) {
+            t = (uint8_t *)rmp_get(&r->pol, wle64(e[i].sid));
+            if(t == NULL) {
+                log_wrn("txn %llx not in pool",
+                        (unsigned long long)wle64(e[i].sid));
+                return (NULL);
+            }
+            z += wle32(((const struct wtx *)t)->len);
+        } else {
+            if(wle32(e[i].off) < f ||
+               (uint64_t)wle32(e[i].off) + wle32(e[i].len) > n)
+                return (NULL);
+            f = (uint64_t)wle32(e[i].off) + wle32(e[i].len);
+            z += wle32(e[i].len);
+        }
+        if(z > rpl_max(RBK) || z > UINT32_MAX)
+            return (NULL);
+    }
+
+    errno = 0;
+    o = (uint8_t *)aligned_alloc(WAL, WAL_UP(z));
+    if(!valid(o)) {
+        log_err("!valid(o)");
+        _exit(EXIT_FAILURE);
+    }
+    memcpy(o, w, sizeof(struct wbh));
+    ((struct wbh *)o)->len = htole32(z);
+    ((struct wbh *)o)->txo = htole32(sizeof(struct wbh));
+    off = (uint32_t *)(o + sizeof(struct wbh));
+    memset(off, 0, WAL_UP(sizeof(uint32_t) * d));
+    q = sizeof(struct wbh) + WAL_UP(sizeof(uint32_t) * d);
+    for(i = 0; i < d; ++i) {
+        off[i] = htole32(q);
+        if(wle32(e[i].len) == 0) {
+            t = (uint8_t *)rmp_get(&r->pol, wle64(e[i].sid));
+            memcpy(o + q, t, wle32(((const struct wtx *)t)->len));
+            q += wle32(((const struct wtx *)t)->len);
+        } else {
+            memcpy(o + q, p + wle32(e[i].off), wle32(e[i].len));
+            q += wle32(e[i].len);
+        }
+    }
+
+    /* the relayed ids must rebuild the root, or the block is never linked */
+    b = NULL;
+    h = wir_chk(o, z);
+    memset(c, 0, BFL);
+    if(h != NULL && memcmp(w->trh, c, BFL) != 0 && !wir_trc(h)) {
+        log_wrn("block %u txn root mismatch", wle32(w->bnm));
+        h = NULL;
+    }
+    l = wle32(w->bnm) == 0 ? INIT : blk_get(wle32(w->bnm) - 1);
+    if(h != NULL && (l == INIT ? blk_cnt() == 0 : l != NULL))
+        b = wir_dec(h, l);
+    free(o);
+    if(b == NULL) {
+        log_wrn("block %u not applied", wle32(w->bnm));
+        return (NULL);
+    }
+
+    /* drop used pool entries */
+    for(i = 0; i < d; ++i) {
+        if(wle32(e[i].len) == 0) {
+            free(rmp_get(&r->pol, wle64(e[i].sid)));
+            rmp_del(&r->pol, wle64(e[i].sid));
+        }
+    }
+
+    return (b);
+}
+
+/*
+ * read and apply one frame. returns its type, with *o set to the new
+ * block for RBK, 0 when the leader closed the stream and -1 on error.
+ */
+int rpl_rcv(struct rpl *const r, struct blk **o)
+{
+    struct rph h;
+    uint64_t t;
+    uint8_t *p, *x;
+    int s;
+
+    if(o != NULL)
+        *o = NULL;
+
+    s = rpl_rdn(r->fd[0], &h, sizeof(h));
+    if(s <= 0)
+        return (s);
+    if(h.len > rpl_max(h.typ))
+        return (-1);
+    p = rpl_buf(r, h.len);
+    if(rpl_rdn(r->fd[0], p, h.len) <= 0)
+        return (-1);
+
+    if(h.typ == RTX) {
+        if(h.len < sizeof(struct wtx) ||
+           wle32(((const struct wtx *)p)->len) != h.len)
+            return (-1);
+        errno = 0;
+        x = (uint8_t *)aligned_alloc(WAL, WAL_UP(h.len));
+        if(!valid(x)) {
+            log_err("!valid(x)");
+            _exit(EXIT_FAILURE);
+        }
+        memcpy(x, p, h.len);
+        t = rpl_sid(((const struct wtx *)x)->hsh);
+        free(rmp_get(&r->pol, t));
+        rmp_put(&r->pol, t, x);
+        r->sts.txn++;
+        return (RTX);
+    }
+
+    if(h.typ == RBK) {
+        if(o == NULL)
+            return (-1);
+        *o = rpl_bld(r, p, h.len);
+        if(*o == NULL)
+            return (-1);
+        t = tsm_get() - h.tsm;
+        r->sts.blk++;
+        r->sts.byt += sizeof(h) + h.len;
+        r->sts.lat += t;
+        if(t > r->sts.mlt)
+            r->sts.mlt = t;
+        return (RBK);
+    }
+
+    return (-1);
+}
+
+void rpl_del(struct rpl *const r)
+{
+    uint32_t i;
+
+    if(!valid(r))
+        return;
+
+    for(i = 0; i < r->nfd; ++i) {
+        close(r->fd[i]);
+        if(r->lfd >= 0)
+            rmp_fre(&r->knw[i]);
+    }
+    if(r->lfd >= 0)
+        close(r->lfd);
+    if(r->pol.key != NULL) {
+        for(i = 0; i <= r->pol.msk; ++i)
+            if(r->pol.key[i] != 0)
+                free(r->pol.val[i]);
+        rmp_fre(&r->pol);
+    }
+    free(r->buf);
+    free(r);
+}
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * rpl.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _RPL_H
+#define _RPL_H
+#include <stdint.h>
+#include <blk.h>
+#include <wir.h>
+
+/* followers per leader */
+#define RFM     16
+/* iovecs per sendmsg, the kernel limit */
+#define RIV     1024
+/* ms a send to one follower may block before it is dropped */
+#define RTO     1000
+
+/* frame types */
+enum {RTX = 1, RBK};
+
+/* frame header, tsm is the leader's send time for latency accounting */
+struct rph {
+    uint32_t typ;
+    uint32_t len;
+    uint64_t tsm;
+};
+
+/*
+ * compact block entry: sid is the first 8 bytes of the txn hash. len 0
+ * means the follower already holds the txn in its pool, otherwise the
+ * full txn record follows inline at off from the start of the payload.
+ */
+struct rce {
+    uint64_t sid;
+    uint32_t off;
+    uint32_t len;
+};
+
+/* open addressed map of short txn ids, key 0 is never stored */
+struct rmp {
+    uint64_t *key;
+    void **val;
+    uint32_t msk;
+    uint32_t cnt;
+};
+
+/* per node counters: blocks, payload bytes, bytes a full record would take */
+struct rps {
+    uint64_t blk;
+    uint64_t txn;
+    uint64_t byt;
+    uint64_t ful;
+    uint64_t inl;
+    uint64_t lat;
+    uint64_t mlt;
+};
+
+struct rpl {
+    int lfd;
+    int fd[RFM];
+    struct rmp knw[RFM];
+    uint32_t nfd;
+    struct rmp pol;
+    uint8_t *buf;
+    uint32_t cap;
+    struct rps sts;
+};
+
+struct rpl* rpl_ldr(const char *path);
+void rpl_acc(struct rpl *const r);
+void rpl_txn(struct rpl *const r, struct txn *const x);
+void rpl_blk(struct rpl *const r, struct blk *const b);
+struct rpl* rpl_fol(const char *path);
+int rpl_rcv(struct rpl *const r, struct blk **o);
+void rpl_del(struct rpl *const r);
+
+#endif
@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * sch.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <sch.h>
+#include <utl.h>
+
+struct sce {
+    uint32_t u;
+    uint32_t v;
+};
+
+/* open addressing map, use lists the nu occupied slots for scm_clr */
+struct scm {
+    uint32_t *key;
+    uint32_t *val;
+    uint32_t *use;
+    uint32_t msk;
+    uint32_t nu;
+};
+
+static void* sch_alc(size_t n)
+{
+    void *p;
+
+    errno = 0;
+    p = malloc(n ? n : 1);
+    if(!valid(p)) {
+        log_err("!valid(p)");
+        _exit(EXIT_FAILURE);
+    }
+
+    return (p);
+}
+
+static void scm_new(struct scm *const m, uint32_t n)
+{
+    uint32_t s;
+
+    for(s = 16; s < n * 2; s <<= 1)
+        ;
+    m->key = (uint32_t *)sch_alc(sizeof(uint32_t) * s);
+    m->val = (uint32_t *)sch_alc(sizeof(uint32_t) * s);
+    m->use = (uint32_t *)sch_alc(sizeof(uint32_t) * s);
+    memset(m->val, 0xff, sizeof(uint32_t) * s);
+    m->msk = s - 1;
+    m->nu = 0;
+}
+
+static void scm_fre(struct scm *const m)
+{
+    free(m->key);
+    free(m->val);
+    free(m->use);
+}
+
+/* empty the map in time proportional to the slots in use */
+static void scm_clr(struct scm *const m)
+{
+    uint32_t i;
+
+    for(i = 0; i < m->nu; ++i)
+        m->val[m->use[i]] = UINT32_MAX;
+    m->nu = 0;
+}
+
+/* slot holding k, or the empty slot where k goes, the caller fills it */
+static uint32_t* scm_slt(struct scm *const m, uint32_t k)
+{
+    uint32_t h;
+
+    h = (k * 2654435761U) & m->msk;
+    while(m->val[h] != UINT32_MAX && m->key[h] != k)
+        h = (h + 1) & m->msk;
+    if(m->val[h] == UINT32_MAX)
+        m->use[m->nu++] = h;
+    m->key[h] = k;
+
+    return (&m->val[h]);
+}
+
+static void sch_edg(struct sce **e, uint32_t *ne, uint32_t *ce,
+                    uint32_t u, uint32_t v)
+{
+    if(*ne == *ce) {
+        *ce = *ce ? *ce * 2 : 256;
+        errno = 0;
+        *e = (struct sce *)realloc(*e, sizeof(struct sce) * *ce);
+        if(!valid(*e)) {
+            log_err("!valid(*e)");
+            _exit(EXIT_FAILURE);
+        }
+    }
+    (*e)[*ne].u = u;
+    (*e)[(*ne)++].v = v;
+}
+
+static void sch_tsk(void *a)
+{
+    struct scn *n, *s;
+    struct scd *g;
+    uint32_t i;
+
+    n = (struct scn *)a;
+    g = n->g;
+    txn_run(g->b, n->i, n->j);
+
+    /* release successors whose last dependency this was */
+    for(i = n->off; i < n->off + n->cnt; ++i) {
+        s = &g->nod[g->suc[i]];
+        if(__atomic_sub_fetch(&s->dep, 1, __ATOMIC_ACQ_REL) == 0)
+            tpl_pun(g->p, g->nd, sch_tsk, s);
+    }
+}
+
+/* build the command dag of b and run it on p in topological order */
+void sch_run(struct blk *const b, struct tpl *const p)
+{
+    struct scd g;
+    struct scm km, gm;
+    struct sce *e;
+    struct txn *x;
+    uint32_t i, j, k, n, ne, ce, lb, sb, *s, *r;
+
+    if(!valid(b) || !valid(p)) {
+        log_err("!valid(b) || !valid(p)");
+        _exit(EXIT_FAILURE);
+    }
+
+    for(i = 0, n = 0; i < b->tdx; ++i)
+        n += b->tta[i].cdx;
+    if(n == 0)
+        return;
+
+    g.nod = (struct scn *)sch_alc(sizeof(struct scn) * n);
+    g.p = p;
+    g.b = b;
+    /* run on the node holding the block's txns */
+    g.nd = mem_own(b->tta);
+    g.n = n;
+    scm_new(&km, n);
+    scm_new(&gm, bcp.cpt);
+    e = NULL;
+    ne = ce = 0;
+
+    /* lb is the last barrier, sb the first node after it */
+    lb = UINT32_MAX;
+    sb = 0;
+    for(i = 0, k = 0; i < b->tdx; ++i) {
+        x = &b->tta[i];
+        scm_clr(&gm);
+        for(j = 0; j < x->cdx; ++j, ++k) {
+            g.nod[k].g = &g;
+            g.nod[k].i = i;
+            g.nod[k].j = j;
+            g.nod[k].dep = 0;
+            g.nod[k].cnt = 0;
+
+            if(x->str[j] == SKB) {
+                for(; sb < k; ++sb)
+                    sch_edg(&e, &ne, &ce, sb, k);
+                lb = k;
+                sb = k + 1;
+                scm_clr(&km);
+            } else {
+                if(lb != UINT32_MAX)
+                    sch_edg(&e, &ne, &ce, lb, k);
+                s = scm_slt(&km, x->str[j]);
+                if(*s != UINT32_MAX)
+                    sch_edg(&e, &ne, &ce, *s, k);
+                *s = k;
+            }
+
+            s = scm_slt(&gm, x->gtr[j]);
+            if(*s != UINT32_MAX)
+                sch_edg(&e, &ne, &ce, *s, k);
+            *s = k;
+        }
+    }
+
+    /* pack successor lists, duplicate edges only cost a decrement */
+    g.suc = (uint32_t *)sch_alc(sizeof(uint32_t) * ne);
+    g.ne = ne;
+    for(i = 0; i < ne; ++i) {
+        g.nod[e[i].u].cnt++;
+        g.nod[e[i].v].dep++;
+    }
+    for(i = 0, k = 0; i < n; ++i) {
+        g.nod[i].off = k;
+        k += g.nod[i].cnt;
+        g.nod[i].cnt = 0;
+    }
+    for(i = 0; i < ne; ++i)
+        g.suc[g.nod[e[i].u].off + g.nod[e[i].u].cnt++] = e[i].v;
+
+    /* collect the roots first, running tasks decrement dep counts */
+    r = (uint32_t *)sch_alc(sizeof(uint32_t) * n);
+    for(i = 0, k = 0; i < n; ++i)
+        if(g.nod[i].dep == 0)
+            r[k++] = i;
+    for(i = 0; i < k; ++i)
+        tpl_pun(p, g.nd, sch_tsk, &g.nod[r[i]]);
+    tpl_wait(p);
+
+    free(r);
+    free(e);
+    free(g.suc);
+    free(g.nod);
+    scm_fre(&km);
+    scm_fre(&gm);
+}
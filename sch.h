@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * sch.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _SCH_H
+#define _SCH_H
+#include <stdint.h>
+#include <blk.h>
+#include <tpl.h>
+
+/*
+ * per-command scheduling metadata, stored in txn.str and txn.gtr:
+ * str[j] is the state key command j touches, commands sharing a key keep
+ * block order and key SKB is a barrier against every other command.
+ * gtr[j] is a group id, commands of one txn in the same group keep txn
+ * order. everything else may run in parallel.
+ */
+#define SKB     0
+
+struct scd;
+
+struct scn {
+    struct scd *g;
+    uint32_t i;
+    uint32_t j;
+    uint32_t dep;
+    uint32_t off;
+    uint32_t cnt;
+};
+
+struct scd {
+    struct scn *nod;
+    uint32_t *suc;
+    struct tpl *p;
+    struct blk *b;
+    uint32_t nd;
+    uint32_t n;
+    uint32_t ne;
+};
+
+void sch_run(struct blk *const b, struct tpl *const p);
+
+#endif
@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * sha.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ * FIPS 180-4 SHA-256 and SHA-512
+ */
+
+#include <string.h>
+#include <sha.h>
+
+#define ROR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+#define RXR(x, n)   (((x) >> (n)) | ((x) << (64 - (n))))
+
+static const uint32_t k256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void sha_blk(struct sha *const s, const uint8_t *p)
+{
+    uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+    uint32_t i;
+
+    for(i = 0; i < 16; ++i)
+        w[i] = (uint32_t)p[i*4] << 24 | (uint32_t)p[i*4+1] << 16 |
+               (uint32_t)p[i*4+2] << 8 | p[i*4+3];
+    for(; i < 64; ++i)
+        w[i] = (ROR(w[i-2], 17) ^ ROR(w[i-2], 19) ^ (w[i-2] >> 10)) + w[i-7] +
+               (ROR(w[i-15], 7) ^ ROR(w[i-15], 18) ^ (w[i-15] >> 3)) + w[i-16];
+
+    a = s->h[0]; b = s->h[1]; c = s->h[2]; d = s->h[3];
+    e = s->h[4]; f = s->h[5]; g = s->h[6]; h = s->h[7];
+    for(i = 0; i < 64; ++i) {
+        t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) +
+             k256[i] + w[i];
+        t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    s->h[0] += a; s->h[1] += b; s->h[2] += c; s->h[3] += d;
+    s->h[4] += e; s->h[5] += f; s->h[6] += g; s->h[7] += h;
+}
+
+void sha_ini(struct sha *const s)
+{
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memcpy(s->h, iv, sizeof(iv));
+    s->n = 0;
+    s->len = 0;
+}
+
+void sha_upd(struct sha *const s, const void *d, size_t n)
+{
+    const uint8_t *p;
+    uint32_t c;
+
+    p = (const uint8_t *)d;
+    s->n += n;
+    if(s->len > 0) {
+        c = 64 - s->len < n ? 64 - s->len : n;
+        memcpy(s->buf + s->len, p, c);
+        s->len += c;
+        p += c;
+        n -= c;
+        if(s->len < 64)
+            return;
+        sha_blk(s, s->buf);
+        s->len = 0;
+    }
+    for(; n >= 64; p += 64, n -= 64)
+        sha_blk(s, p);
+    memcpy(s->buf, p, n);
+    s->len = n;
+}
+
+void sha_fin(struct sha *const s, uint8_t o[SHL])
+{
+    uint64_t b;
+    uint32_t i;
+
+    b = s->n * 8;
+    s->buf[s->len++] = 0x80;
+    if(s->len > 56) {
+        memset(s->buf + s->len, 0, 64 - s->len);
+        sha_blk(s, s->buf);
+        s->len = 0;
+    }
+    memset(s->buf + s->len, 0, 56 - s->len);
+    for(i = 0; i < 8; ++i)
+        s->buf[56 + i] = b >> (56 - i*8);
+    sha_blk(s, s->buf);
+
+    for(i = 0; i < 8; ++i) {
+        o[i*4] = s->h[i] >> 24;
+        o[i*4+1] = s->h[i] >> 16;
+        o[i*4+2] = s->h[i] >> 8;
+        o[i*4+3] = s->h[i];
+    }
+}
+
+void sha_256(uint8_t o[SHL], const void *d, size_t n)
+{
+    struct sha s;
+
+    sha_ini(&s);
+    sha_upd(&s, d, n);
+    sha_fin(&s, o);
+}
+
+static const uint64_t k512[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+    0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+    0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+    0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+    0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+    0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+    0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+    0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+    0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+    0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+    0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+    0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+    0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+    0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+    0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+    0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+    0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+    0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+    0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+    0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+    0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static void shx_blk(struct shx *const s, const uint8_t *p)
+{
+    uint64_t w[80], a, b, c, d, e, f, g, h, t1, t2;
+    uint32_t i, j;
+
+    for(i = 0; i < 16; ++i)
+        for(j = 0, w[i] = 0; j < 8; ++j)
+            w[i] = w[i] << 8 | p[i*8+j];
+    for(; i < 80; ++i)
+        w[i] = (RXR(w[i-2], 19) ^ RXR(w[i-2], 61) ^ (w[i-2] >> 6)) + w[i-7] +
+               (RXR(w[i-15], 1) ^ RXR(w[i-15], 8) ^ (w[i-15] >> 7)) + w[i-16];
+
+    a = s->h[0]; b = s->h[1]; c = s->h[2]; d = s->h[3];
+    e = s->h[4]; f = s->h[5]; g = s->h[6]; h = s->h[7];
+    for(i = 0; i < 80; ++i) {
+        t1 = h + (RXR(e, 14) ^ RXR(e, 18) ^ RXR(e, 41)) + ((e & f) ^ (~e & g)) +
+             k512[i] + w[i];
+        t2 = (RXR(a, 28) ^ RXR(a, 34) ^ RXR(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    s->h[0] += a; s->h[1] += b; s->h[2] += c; s->h[3] += d;
+    s->h[4] += e; s->h[5] += f; s->h[6] += g; s->h[7] += h;
+}
+
+void shx_ini(struct shx *const s)
+{
+    static const uint64_t iv[8] = {
+        0x6a09e667f3bcc908ULL,
+        0xbb67ae8584caa73bULL,
+        0x3c6ef372fe94f82bULL,
+        0xa54ff53a5f1d36f1ULL,
+        0x510e527fade682d1ULL,
+        0x9b05688c2b3e6c1fULL,
+        0x1f83d9abfb41bd6bULL,
+        0x5be0cd19137e2179ULL
+    };
+
+    memcpy(s->h, iv, sizeof(iv));
+    s->n = 0;
+    s->len = 0;
+}
+
+void shx_upd(struct shx *const s, const void *d, size_t n)
+{
+    const uint8_t *p;
+    uint32_t c;
+
+    p = (const uint8_t *)d;
+    s->n += n;
+    if(s->len > 0) {
+        c = 128 - s->len < n ? 128 - s->len : n;
+        memcpy(s->buf + s->len, p, c);
+        s->len += c;
+        p += c;
+        n -= c;
+        if(s->len < 128)
+            return;
+        shx_blk(s, s->buf);
+        s->len = 0;
+    }
+    for(; n >= 128; p += 128, n -= 128)
+        shx_blk(s, p);
+    memcpy(s->buf, p, n);
+    s->len = n;
+}
+
+/* message length is kept in 64 bits, the upper half of the field is 0 */
+void shx_fin(struct shx *const s, uint8_t o[SXL])
+{
+    uint64_t b;
+    uint32_t i;
+
+    b = s->n * 8;
+    s->buf[s->len++] = 0x80;
+    if(s->len > 112) {
+        memset(s->buf + s->len, 0, 128 - s->len);
+        shx_blk(s, s->buf);
+        s->len = 0;
+    }
+    memset(s->buf + s->len, 0, 120 - s->len);
+    for(i = 0; i < 8; ++i)
+        s->buf[120 + i] = b >> (56 - i*8);
+    shx_blk(s, s->buf);
+
+    for(i = 0; i < 64; ++i)
+        o[i] = s->h[i/8] >> (56 - (i%8)*8);
+}
+
+void sha_512(uint8_t o[SXL], const void *d, size_t n)
+{
+    struct shx s;
+
+    shx_ini(&s);
+    shx_upd(&s, d, n);
+    shx_fin(&s, o);
+}
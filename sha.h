@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * sha.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _SHA_H
+#define _SHA_H
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHL     32
+#define SXL     64
+
+struct sha {
+    uint32_t h[8];
+    uint64_t n;
+    uint8_t buf[64];
+    uint32_t len;
+};
+
+struct shx {
+    uint64_t h[8];
+    uint64_t n;
+    uint8_t buf[128];
+    uint32_t len;
+};
+
+void sha_ini(struct sha *const s);
+void sha_upd(struct sha *const s, const void *d, size_t n);
+void sha_fin(struct sha *const s, uint8_t o[SHL]);
+void sha_256(uint8_t o[SHL], const void *d, size_t n);
+void shx_ini(struct shx *const s);
+void shx_upd(struct shx *const s, const void *d, size_t n);
+void shx_fin(struct shx *const s, uint8_t o[SXL]);
+void sha_512(uint8_t o[SXL], const void *d, size_t n);
+
+#endif
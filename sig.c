@@ -0,0 +1,849 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * sig.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ * Ed25519 (RFC 8032) over radix 2^16 field elements, with randomized
+ * batch verification as a single multi-scalar multiplication.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/random.h>
+#include <sig.h>
+#include <sha.h>
+#include <tpl.h>
+#include <utl.h>
+
+typedef int64_t gf[16];
+
+struct svc {
+    uint8_t hsh[BFL];
+    uint8_t pbk[PKL];
+    uint8_t sig[SGL];
+    uint32_t vld;
+};
+
+struct sbj {
+    struct blk *b;
+    uint32_t *idx;
+    uint8_t *res;
+    uint32_t cnt;
+    uint32_t *pnd;
+};
+
+static const gf gf0;
+static const gf gf1 = {1};
+static gf D, D2, I, BX, BY;
+static pthread_once_t sgo = PTHREAD_ONCE_INIT;
+
+static struct svc svc[SCS];
+static pthread_mutex_t svm[64];
+
+static const int64_t L[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58,
+    0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10
+};
+
+static void set25519(gf r, const gf a)
+{
+    int i;
+
+    for(i = 0; i < 16; ++i)
+        r[i] = a[i];
+}
+
+static void car25519(gf o)
+{
+    int64_t c;
+    int i;
+
+    for(i = 0; i < 16; ++i) {
+        o[i] += (1LL << 16);
+        c = o[i] >> 16;
+        o[(i+1)*(i<15)] += c-1 + 37*(c-1)*(i==15);
+        o[i] -= c * 65536;
+    }
+}
+
+static void sel25519(gf p, gf q, int b)
+{
+    int64_t t, c;
+    int i;
+
+    c = ~(b-1);
+    for(i = 0; i < 16; ++i) {
+        t = c & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+static void pack25519(uint8_t *o, const gf n)
+{
+    gf m, t;
+    int i, j, b;
+
+    set25519(t, n);
+    car25519(t);
+    car25519(t);
+    car25519(t);
+    for(j = 0; j < 2; ++j) {
+        m[0] = t[0] - 0xffed;
+        for(i = 1; i < 15; ++i) {
+            m[i] = t[i] - 0xffff - ((m[i-1] >> 16) & 1);
+            m[i-1] &= 0xffff;
+        }
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        b = (m[15] >> 16) & 1;
+        m[14] &= 0xffff;
+        sel25519(t, m, 1-b);
+    }
+    for(i = 0; i < 16; ++i) {
+        o[2*i] = t[i] & 0xff;
+        o[2*i+1] = t[i] >> 8;
+    }
+}
+
+static int neq25519(const gf a, const gf b)
+{
+    uint8_t c[32], d[32];
+
+    pack25519(c, a);
+    pack25519(d, b);
+
+    return (memcmp(c, d, 32) != 0);
+}
+
+static uint8_t par25519(const gf a)
+{
+    uint8_t d[32];
+
+    pack25519(d, a);
+
+    return (d[0] & 1);
+}
+
+static void unpack25519(gf o, const uint8_t *n)
+{
+    int i;
+
+    for(i = 0; i < 16; ++i)
+        o[i] = n[2*i] + ((int64_t)n[2*i+1] << 8);
+    o[15] &= 0x7fff;
+}
+
+static void A(gf o, const gf a, const gf b)
+{
+    int i;
+
+    for(i = 0; i < 16; ++i)
+        o[i] = a[i] + b[i];
+}
+
+static void Z(gf o, const gf a, const gf b)
+{
+    int i;
+
+    for(i = 0; i < 16; ++i)
+        o[i] = a[i] - b[i];
+}
+
+static void M(gf o, const gf a, const gf b)
+{
+    int64_t t[31];
+    int i, j;
+
+    for(i = 0; i < 31; ++i)
+        t[i] = 0;
+    for(i = 0; i < 16; ++i)
+        for(j = 0; j < 16; ++j)
+            t[i+j] += a[i] * b[j];
+    for(i = 0; i < 15; ++i)
+        t[i] += 38 * t[i+16];
+    for(i = 0; i < 16; ++i)
+        o[i] = t[i];
+    car25519(o);
+    car25519(o);
+}
+
+static void S(gf o, const gf a)
+{
+    M(o, a, a);
+}
+
+/* a^(p-2) */
+static void inv25519(gf o, const gf i)
+{
+    gf c;
+    int a;
+
+    set25519(c, i);
+    for(a = 253; a >= 0; --a) {
+        S(c, c);
+        if(a != 2 && a != 4)
+            M(c, c, i);
+    }
+    set25519(o, c);
+}
+
+/* a^((p-5)/8) */
+static void pow2523(gf o, const gf i)
+{
+    gf c;
+    int a;
+
+    set25519(c, i);
+    for(a = 250; a >= 0; --a) {
+        S(c, c);
+        if(a != 1)
+            M(c, c, i);
+    }
+    set25519(o, c);
+}
+
+/* p += q in extended coordinates, p and q may alias */
+static void add(gf p[4], gf q[4])
+{
+    gf a, b, c, d, t, e, f, g, h;
+
+    Z(a, p[1], p[0]);
+    Z(t, q[1], q[0]);
+    M(a, a, t);
+    A(b, p[0], p[1]);
+    A(t, q[0], q[1]);
+    M(b, b, t);
+    M(c, p[3], q[3]);
+    M(c, c, D2);
+    M(d, p[2], q[2]);
+    A(d, d, d);
+    Z(e, b, a);
+    Z(f, d, c);
+    A(g, d, c);
+    A(h, b, a);
+
+    M(p[0], e, f);
+    M(p[1], h, g);
+    M(p[2], g, f);
+    M(p[3], e, h);
+}
+
+static void cswap(gf p[4], gf q[4], uint8_t b)
+{
+    int i;
+
+    for(i = 0; i < 4; ++i)
+        sel25519(p[i], q[i], b);
+}
+
+static void pack(uint8_t *r, gf p[4])
+{
+    gf tx, ty, zi;
+
+    inv25519(zi, p[2]);
+    M(tx, p[0], zi);
+    M(ty, p[1], zi);
+    pack25519(r, ty);
+    r[31] ^= par25519(tx) << 7;
+}
+
+static void idt(gf p[4])
+{
+    set25519(p[0], gf0);
+    set25519(p[1], gf1);
+    set25519(p[2], gf1);
+    set25519(p[3], gf0);
+}
+
+/* p = s*q with a uniform ladder, used for secret scalars */
+static void scalarmult(gf p[4], gf q[4], const uint8_t *s)
+{
+    uint8_t b;
+    int i;
+
+    idt(p);
+    for(i = 255; i >= 0; --i) {
+        b = (s[i/8] >> (i&7)) & 1;
+        cswap(p, q, b);
+        add(q, p);
+        add(p, p);
+        cswap(p, q, b);
+    }
+}
+
+static void scalarbase(gf p[4], const uint8_t *s)
+{
+    gf q[4];
+
+    set25519(q[0], BX);
+    set25519(q[1], BY);
+    set25519(q[2], gf1);
+    M(q[3], BX, BY);
+    scalarmult(p, q, s);
+}
+
+/* decode p and negate it, -1 when p is not on the curve */
+static int unpackneg(gf r[4], const uint8_t p[32])
+{
+    gf t, chk, num, den, den2, den4, den6;
+
+    set25519(r[2], gf1);
+    unpack25519(r[1], p);
+    S(num, r[1]);
+    M(den, num, D);
+    Z(num, num, r[2]);
+    A(den, r[2], den);
+
+    S(den2, den);
+    S(den4, den2);
+    M(den6, den4, den2);
+    M(t, den6, num);
+    M(t, t, den);
+
+    pow2523(t, t);
+    M(t, t, num);
+    M(t, t, den);
+    M(t, t, den);
+    M(r[0], t, den);
+
+    S(chk, r[0]);
+    M(chk, chk, den);
+    if(neq25519(chk, num))
+        M(r[0], r[0], I);
+
+    S(chk, r[0]);
+    M(chk, chk, den);
+    if(neq25519(chk, num))
+        return (-1);
+
+    if(par25519(r[0]) == (p[31] >> 7))
+        Z(r[0], gf0, r[0]);
+
+    M(r[3], r[0], r[1]);
+
+    return (0);
+}
+
+static void modL(uint8_t *r, int64_t x[64])
+{
+    int64_t carry, i, j;
+
+    for(i = 63; i >= 32; --i) {
+        carry = 0;
+        for(j = i - 32; j < i - 12; ++j) {
+            x[j] += carry - 16 * x[i] * L[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+    carry = 0;
+    for(j = 0; j < 32; ++j) {
+        x[j] += carry - (x[31] >> 4) * L[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for(j = 0; j < 32; ++j)
+        x[j] -= carry * L[j];
+    for(i = 0; i < 32; ++i) {
+        x[i+1] += x[i] >> 8;
+        r[i] = x[i] & 255;
+    }
+}
+
+/* reduce a 64 byte little endian number mod L into its first 32 bytes */
+static void reduce(uint8_t *r)
+{
+    int64_t x[64];
+    int i;
+
+    for(i = 0; i < 64; ++i)
+        x[i] = (uint64_t)r[i];
+    for(i = 0; i < 64; ++i)
+        r[i] = 0;
+    modL(r, x);
+}
+
+/* r = a*b + c mod L */
+static void scmuladd(uint8_t r[32], const uint8_t *a, uint32_t na,
+                     const uint8_t b[32], const uint8_t c[32])
+{
+    int64_t x[64];
+    uint32_t i, j;
+
+    for(i = 0; i < 64; ++i)
+        x[i] = 0;
+    for(i = 0; i < 32; ++i)
+        x[i] = (uint64_t)c[i];
+    for(i = 0; i < na; ++i)
+        for(j = 0; j < 32; ++j)
+            x[i+j] += a[i] * (int64_t)b[j];
+    modL(r, x);
+}
+
+/* 1 when the little endian scalar s is canonical, s < L */
+static int sclt(const uint8_t s[32])
+{
+    int i;
+
+    for(i = 31; i >= 0; --i) {
+        if(s[i] < L[i])
+            return (1);
+        if(s[i] > L[i])
+            return (0);
+    }
+
+    return (0);
+}
+
+/* field constants are derived once instead of being tabulated */
+static void sig_ini(void)
+{
+    gf t, u;
+    uint8_t b[32];
+    int a, i;
+
+    /* d = -121665/121666 */
+    set25519(t, gf0);
+    t[0] = 0xdb42;
+    t[1] = 1;
+    inv25519(u, t);
+    t[0] = 0xdb41;
+    M(t, t, u);
+    Z(D, gf0, t);
+    A(D2, D, D);
+
+    /* sqrt(-1) = 2^((p-1)/4) */
+    set25519(u, gf0);
+    u[0] = 2;
+    set25519(I, u);
+    for(a = 251; a >= 0; --a) {
+        S(I, I);
+        if(a != 2)
+            M(I, I, u);
+    }
+
+    /* base point y = 4/5, x is the even root */
+    set25519(t, gf0);
+    t[0] = 5;
+    inv25519(u, t);
+    set25519(t, gf0);
+    t[0] = 4;
+    M(BY, t, u);
+    pack25519(b, BY);
+    {
+        gf p[4];
+
+        set25519(BX, gf0);
+        if(unpackneg(p, b) != 0) {
+            log_err("base point");
+            _exit(EXIT_FAILURE);
+        }
+        Z(BX, gf0, p[0]);
+    }
+
+    for(i = 0; i < 64; ++i)
+        pthread_mutex_init(&svm[i], NULL);
+}
+
+void sig_key(uint8_t pk[PKL], uint8_t sk[SKL], const uint8_t sd[SDL])
+{
+    uint8_t d[64];
+    gf p[4];
+
+    pthread_once(&sgo, sig_ini);
+
+    sha_512(d, sd, SDL);
+    d[0] &= 248;
+    d[31] &= 127;
+    d[31] |= 64;
+    scalarbase(p, d);
+    pack(pk, p);
+
+    memcpy(sk, sd, SDL);
+    memcpy(sk + SDL, pk, PKL);
+}
+
+void sig_sgn(uint8_t s[SGL], const uint8_t *m, size_t n, const uint8_t sk[SKL])
+{
+    struct shx h;
+    uint8_t d[64], r[64], k[64];
+    gf p[4];
+
+    pthread_once(&sgo, sig_ini);
+
+    sha_512(d, sk, SDL);
+    d[0] &= 248;
+    d[31] &= 127;
+    d[31] |= 64;
+
+    shx_ini(&h);
+    shx_upd(&h, d + 32, 32);
+    shx_upd(&h, m, n);
+    shx_fin(&h, r);
+    reduce(r);
+    scalarbase(p, r);
+    pack(s, p);
+
+    shx_ini(&h);
+    shx_upd(&h, s, 32);
+    shx_upd(&h, sk + SDL, PKL);
+    shx_upd(&h, m, n);
+    shx_fin(&h, k);
+    reduce(k);
+
+    scmuladd(s + 32, k, 32, d, r);
+}
+
+/* k = H(R || A || M) mod L */
+static void sig_hrm(uint8_t k[64], const uint8_t s[SGL], const uint8_t *m,
+                    size_t n, const uint8_t pk[PKL])
+{
+    struct shx h;
+
+    shx_ini(&h);
+    shx_upd(&h, s, 32);
+    shx_upd(&h, pk, PKL);
+    shx_upd(&h, m, n);
+    shx_fin(&h, k);
+    reduce(k);
+}
+
+/*
+ * 1 when s is a valid signature of m under pk. the check is cofactored,
+ * [8](sB - R - kA) is the identity as in ZIP-215, the equation sig_bat
+ * tests for a whole batch, so a signature passes alone exactly when it
+ * passes in any batch.
+ */
+int sig_vfy(const uint8_t s[SGL], const uint8_t *m, size_t n,
+            const uint8_t pk[PKL])
+{
+    uint8_t k[64], t[32];
+    gf p[4], q[4], r[4];
+    int i;
+
+    pthread_once(&sgo, sig_ini);
+
+    if(!sclt(s + 32))
+        return (0);
+    if(unpackneg(q, pk) != 0 || unpackneg(r, s) != 0)
+        return (0);
+
+    sig_hrm(k, s, m, n, pk);
+    scalarmult(p, q, k);
+    scalarbase(q, s + 32);
+    add(p, q);
+    add(p, r);
+    for(i = 0; i < 3; ++i)
+        add(p, p);
+    pack(t, p);
+    memset(k, 0, 32);
+    k[0] = 1;
+
+    return (memcmp(t, k, 32) == 0);
+}
+
+/*
+ * 1 when all c signatures are valid. with random z_i the batch holds iff
+ * 8*([sum z_i s_i]B - sum z_i R_i - sum [z_i k_i]A_i) is the identity,
+ * evaluated as one interleaved 4-bit window multi-scalar multiplication,
+ * so the 256 doublings are shared by every point in the batch.
+ */
+int sig_bat(const uint8_t *const *s, const uint8_t *const *m, const size_t *n,
+            const uint8_t *const *pk, uint32_t c)
+{
+    gf (*tb)[16][4], acc[4];
+    uint8_t (*sc)[32], z[16], k[64], sb[32], t[32];
+    uint32_t np, i, j, w, d;
+    int r;
+
+    if(c == 0)
+        return (1);
+
+    pthread_once(&sgo, sig_ini);
+
+    np = 2 * c + 1;
+    errno = 0;
+    tb = malloc(sizeof(*tb) * np);
+    sc = malloc(sizeof(*sc) * np);
+    if(!valid(tb) || !valid(sc)) {
+        log_err("!valid(tb) || !valid(sc)");
+        _exit(EXIT_FAILURE);
+    }
+
+    r = 0;
+    memset(sb, 0, sizeof(sb));
+    memset(sc, 0, sizeof(*sc) * np);
+    for(i = 0; i < c; ++i) {
+        if(!sclt(s[i] + 32))
+            goto out;
+        if(unpackneg(tb[2*i+1][1], s[i]) != 0 ||
+           unpackneg(tb[2*i+2][1], pk[i]) != 0)
+            goto out;
+        if(getrandom(z, sizeof(z), 0) != sizeof(z))
+            goto out;
+
+        /* -R_i with z_i, -A_i with z_i*k_i, B with sum z_i*s_i */
+        memcpy(sc[2*i+1], z, sizeof(z));
+        sig_hrm(k, s[i], m[i], n[i], pk[i]);
+        memset(t, 0, sizeof(t));
+        scmuladd(sc[2*i+2], z, sizeof(z), k, t);
+        scmuladd(sb, z, sizeof(z), s[i] + 32, sb);
+    }
+    memcpy(sc[0], sb, 32);
+    set25519(tb[0][1][0], BX);
+    set25519(tb[0][1][1], BY);
+    set25519(tb[0][1][2], gf1);
+    M(tb[0][1][3], BX, BY);
+
+    for(i = 0; i < np; ++i) {
+        for(j = 2; j < 16; ++j) {
+            memcpy(tb[i][j], tb[i][j-1], sizeof(tb[i][j]));
+            add(tb[i][j], tb[i][1]);
+        }
+    }
+
+    idt(acc);
+    for(w = 64; w-- > 0;) {
+        if(w != 63)
+            for(j = 0; j < 4; ++j)
+                add(acc, acc);
+        for(i = 0; i < np; ++i) {
+            d = (sc[i][w/2] >> (4 * (w & 1))) & 15;
+            if(d != 0)
+                add(acc, tb[i][d]);
+        }
+    }
+    for(j = 0; j < 3; ++j)
+        add(acc, acc);
+
+    pack(t, acc);
+    memset(k, 0, 32);
+    k[0] = 1;
+    r = (memcmp(t, k, 32) == 0);
+
+out:
+    free(tb);
+    free(sc);
+
+    return (r);
+}
+
+/* RFC 8032 section 7.1 test 1 */
+static const uint8_t ksd[SDL] = {
+    0x9d, 0x61, 0xb1, 0x9d, 0xef, 0xfd, 0x5a, 0x60, 0xba, 0x84, 0x4a, 0xf4,
+    0x92, 0xec, 0x2c, 0xc4, 0x44, 0x49, 0xc5, 0x69, 0x7b, 0x32, 0x69, 0x19,
+    0x70, 0x3b, 0xac, 0x03, 0x1c, 0xae, 0x7f, 0x60,
+};
+
+static const uint8_t kpk[PKL] = {
+    0xd7, 0x5a, 0x98, 0x01, 0x82, 0xb1, 0x0a, 0xb7, 0xd5, 0x4b, 0xfe, 0xd3,
+    0xc9, 0x64, 0x07, 0x3a, 0x0e, 0xe1, 0x72, 0xf3, 0xda, 0xa6, 0x23, 0x25,
+    0xaf, 0x02, 0x1a, 0x68, 0xf7, 0x07, 0x51, 0x1a,
+};
+
+static const uint8_t ksg[SGL] = {
+    0xe5, 0x56, 0x43, 0x00, 0xc3, 0x60, 0xac, 0x72, 0x90, 0x86, 0xe2, 0xcc,
+    0x80, 0x6e, 0x82, 0x8a, 0x84, 0x87, 0x7f, 0x1e, 0xb8, 0xe5, 0xd9, 0x74,
+    0xd8, 0x73, 0xe0, 0x65, 0x22, 0x49, 0x01, 0x55, 0x5f, 0xb8, 0x82, 0x15,
+    0x90, 0xa3, 0x3b, 0xac, 0xc6, 0x1e, 0x39, 0x70, 0x1c, 0xf9, 0xb4, 0x6b,
+    0xd2, 0x5b, 0xf5, 0xf0, 0x59, 0x5b, 0xbe, 0x24, 0x65, 0x51, 0x41, 0x43,
+    0x8e, 0x7a, 0x10, 0x0b,
+};
+
+/*
+ * known answers, 1 when all hold: RFC 8032 test 1, then a signature by
+ * the same key whose R carries the order two point (0, -1). it fails the
+ * cofactorless check, and has to pass single and batched alike.
+ */
+int sig_kat(void)
+{
+    const uint8_t *sv[2], *mv[2], *pv[2];
+    uint8_t pk[PKL], sk[SKL], s[SGL], d[64], r[64], k[64];
+    size_t nv[2];
+    gf p[4], t[4];
+
+    sig_key(pk, sk, ksd);
+    sig_sgn(s, (const uint8_t *)"", 0, sk);
+    if(memcmp(pk, kpk, PKL) != 0 || memcmp(s, ksg, SGL) != 0 ||
+       !sig_vfy(s, (const uint8_t *)"", 0, pk))
+        return (0);
+
+    /* R = rB + (0, -1), S = r + H(R || A || M) a */
+    sha_512(d, ksd, SDL);
+    d[0] &= 248;
+    d[31] &= 127;
+    d[31] |= 64;
+    memset(r, 0, sizeof(r));
+    r[0] = 7;
+    scalarbase(p, r);
+    set25519(t[0], gf0);
+    Z(t[1], gf0, gf1);
+    set25519(t[2], gf1);
+    set25519(t[3], gf0);
+    add(p, t);
+    pack(s, p);
+    sig_hrm(k, s, (const uint8_t *)"", 0, pk);
+    scmuladd(s + 32, k, 32, d, r);
+
+    sv[0] = sv[1] = s;
+    mv[0] = mv[1] = (const uint8_t *)"";
+    nv[0] = nv[1] = 0;
+    pv[0] = pv[1] = pk;
+
+    return (sig_vfy(s, (const uint8_t *)"", 0, pk) &&
+            sig_bat(sv, mv, nv, pv, 2));
+}
+
+static struct svc* svc_slt(const uint8_t h[BFL])
+{
+    uint32_t i;
+
+    memcpy(&i, h, sizeof(i));
+
+    return (&svc[i & (SCS - 1)]);
+}
+
+static int svc_hit(const struct txn *const x)
+{
+    struct svc *e;
+    int r;
+
+    e = svc_slt(x->hsh);
+    pthread_mutex_lock(&svm[(e - svc) & 63]);
+    r = e->vld && !memcmp(e->hsh, x->hsh, BFL) &&
+        !memcmp(e->pbk, x->pbk, PKL) && !memcmp(e->sig, x->sig, SGL);
+    pthread_mutex_unlock(&svm[(e - svc) & 63]);
+
+    return (r);
+}
+
+static void svc_put(const struct txn *const x)
+{
+    struct svc *e;
+
+    e = svc_slt(x->hsh);
+    pthread_mutex_lock(&svm[(e - svc) & 63]);
+    memcpy(e->hsh, x->hsh, BFL);
+    memcpy(e->pbk, x->pbk, PKL);
+    memcpy(e->sig, x->sig, SGL);
+    e->vld = 1;
+    pthread_mutex_unlock(&svm[(e - svc) & 63]);
+}
+
+/* verify one chunk as a batch, fall back to single checks on failure */
+static void sig_job(void *a)
+{
+    const uint8_t *s[SBT], *m[SBT], *pk[SBT];
+    size_t n[SBT];
+    struct sbj *j;
+    struct txn *x;
+    uint32_t i;
+    int ok;
+
+    j = (struct sbj *)a;
+    for(i = 0; i < j->cnt; ++i) {
+        x = &j->b->tta[j->idx[i]];
+        s[i] = x->sig;
+        m[i] = x->hsh;
+        n[i] = BFL;
+        pk[i] = x->pbk;
+    }
+
+    ok = sig_bat(s, m, n, pk, j->cnt);
+    for(i = 0; i < j->cnt; ++i) {
+        x = &j->b->tta[j->idx[i]];
+        j->res[i] = ok ? 1 : sig_vfy(x->sig, x->hsh, BFL, x->pbk);
+        if(j->res[i])
+            svc_put(x);
+    }
+
+    __atomic_sub_fetch(j->pnd, 1, __ATOMIC_RELEASE);
+}
+
+/* sign the last txn added to b, its hash covers the signer key */
+void txn_sgn(struct blk *const b, const uint8_t sk[SKL])
+{
+    struct txn *x;
+
+    if(!valid(b) || !valid(b->tta) || b->tdx == 0) {
+        log_err("!valid(b) || b->tdx == 0");
+        _exit(EXIT_FAILURE);
+    }
+
+    x = &b->tta[b->tdx-1];
+    memcpy(x->pbk, sk + SDL, PKL);
+    txn_hsh(x);
+    sig_sgn(x->sig, x->hsh, BFL, sk);
+}
+
+/*
+ * 1 when every txn of b carries a valid signature over its hash. txn
+ * hashes must be current (blk_hsh). cache misses are verified in batches
+ * of SBT on p, or inline when p is NULL.
+ */
+int sig_blk(struct blk *const b, struct tpl *const p)
+{
+    struct sbj *j;
+    uint32_t *idx, i, n, nj, pnd;
+    uint8_t *res;
+    int r;
+
+    if(!valid(b)) {
+        log_err("!valid(b)");
+        _exit(EXIT_FAILURE);
+    }
+    if(b->tdx == 0)
+        return (1);
+
+    /* the chunks read the txns on the pool until every one is done */
+    blk_pin(b);
+    if(!valid(b->tta)) {
+        log_err("!valid(b->tta)");
+        _exit(EXIT_FAILURE);
+    }
+
+    pthread_once(&sgo, sig_ini);
+
+    errno = 0;
+    idx = (uint32_t *)malloc(sizeof(uint32_t) * b->tdx);
+    res = (uint8_t *)malloc(b->tdx);
+    j = (struct sbj *)malloc(sizeof(struct sbj) * (b->tdx / SBT + 1));
+    if(!valid(idx) || !valid(res) || !valid(j)) {
+        log_err("!valid(idx) || !valid(res) || !valid(j)");
+        _exit(EXIT_FAILURE);
+    }
+
+    for(i = 0, n = 0; i < b->tdx; ++i)
+        if(!svc_hit(&b->tta[i]))
+            idx[n++] = i;
+
+    nj = (n + SBT - 1) / SBT;
+    pnd = nj;
+    for(i = 0; i < nj; ++i) {
+        j[i].b = b;
+        j[i].idx = idx + i * SBT;
+        j[i].res = res + i * SBT;
+        j[i].cnt = n - i * SBT < SBT ? n - i * SBT : SBT;
+        j[i].pnd = &pnd;
+        if(p != NULL)
+            tpl_put(p, sig_job, &j[i]);
+        else
+            sig_job(&j[i]);
+    }
+    while(__atomic_load_n(&pnd, __ATOMIC_ACQUIRE) != 0)
+        sched_yield();
+
+    for(i = 0, r = 1; i < n; ++i)
+        r &= res[i];
+
+    free(idx);
+    free(res);
+    free(j);
+    blk_rel(b);
+
+    return (r);
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * sig.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _SIG_H
+#define _SIG_H
+#include <stddef.h>
+#include <stdint.h>
+#include <blk.h>
+
+#define SGL     64
+#define PKL     32
+#define SKL     64
+#define SDL     32
+
+/* chunk of txns verified as one batch by a pool task */
+#define SBT     64
+
+/* verified signature cache, direct mapped by txn hash */
+#define SCB     14
+#define SCS     (1U << SCB)
+
+void sig_key(uint8_t pk[PKL], uint8_t sk[SKL], const uint8_t sd[SDL]);
+void sig_sgn(uint8_t s[SGL], const uint8_t *m, size_t n, const uint8_t sk[SKL]);
+int sig_vfy(const uint8_t s[SGL], const uint8_t *m, size_t n,
+            const uint8_t pk[PKL]);
+int sig_bat(const uint8_t *const *s, const uint8_t *const *m, const size_t *n,
+            const uint8_t *const *pk, uint32_t c);
+int sig_kat(void);
+void txn_sgn(struct blk *const b, const uint8_t sk[SKL]);
+int sig_blk(struct blk *const b, struct tpl *const p);
+
+#endif
@@ -0,0 +1,645 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * tir.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <tir.h>
+#include <cmp.h>
+#include <mem.h>
+#include <utl.h>
+#include <wir.h>
+#include <pthread.h>
+#include <stddef.h>
+
+uint32_t tir_on = 0;
+
+static pthread_once_t tir_fko = PTHREAD_ONCE_INIT;
+
+static struct {
+    pthread_mutex_t mtx;
+    struct lst_head lru;
+    struct tfz **ent;
+    uint32_t nen;
+    uint32_t age;
+    uint32_t cap;
+    uint8_t *rbf;
+    size_t rbm;
+    uint8_t *zbf;
+    size_t zbm;
+    struct tis sts;
+} tir = {
+    .mtx = PTHREAD_MUTEX_INITIALIZER,
+    .lru = LST_HEAD_INIT(tir.lru),
+};
+
+/* record reader, any overrun means the record was damaged in memory */
+struct trd {
+    const uint8_t *p;
+    const uint8_t *e;
+};
+
+static uint64_t mtm_get(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec*1000000000UL + tp.tv_nsec;
+}
+
+static void tir_bad(void)
+{
+    log_err("corrupt tier record");
+    _exit(EXIT_FAILURE);
+}
+
+static uint8_t* tir_pvu(uint8_t *o, uint64_t v)
+{
+    for(; v >= 0x80; v >>= 7)
+        *o++ = (uint8_t)v | 0x80;
+    *o++ = (uint8_t)v;
+
+    return (o);
+}
+
+/* signed deltas zigzag to small unsigned values */
+static uint8_t* tir_pvz(uint8_t *o, int64_t v)
+{
+    return (tir_pvu(o, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63)));
+}
+
+static uint8_t* tir_pby(uint8_t *o, const void *p, size_t n)
+{
+    memcpy(o, p, n);
+    return (o + n);
+}
+
+static uint64_t tir_gvu(struct trd *const r)
+{
+    uint64_t v;
+    uint32_t s;
+    uint8_t c;
+
+    v = 0;
+    s = 0;
+    do {
+        if(r->p >= r->e || s > 63)
+            tir_bad();
+        c = *r->p++;
+        v |= (uint64_t)(c & 0x7f) << s;
+        s += 7;
+    } while(c & 0x80);
+
+    return (v);
+}
+
+static int64_t tir_gvz(struct trd *const r)
+{
+    uint64_t u;
+
+    u = tir_gvu(r);
+    return ((int64_t)(u >> 1) ^ -(int64_t)(u & 1));
+}
+
+static void tir_gby(struct trd *const r, void *d, size_t n)
+{
+    if((size_t)(r->e - r->p) < n)
+        tir_bad();
+    memcpy(d, r->p, n);
+    r->p += n;
+}
+
+static uint8_t* tir_buf(uint8_t **b, size_t *m, size_t n)
+{
+    if(*m < n) {
+        free(*b);
+        errno = 0;
+        *b = (uint8_t *)malloc(n);
+        if(!valid(*b)) {
+            log_err("!valid(*b)");
+            _exit(EXIT_FAILURE);
+        }
+        *m = n;
+    }
+
+    return (*b);
+}
+
+/* record size bound, varints take at most 10 bytes */
+static size_t tir_bnd(struct blk *const b)
+{
+    size_t n;
+    uint32_t i;
+
+    n = 16 + sizeof(struct bcd);
+    for(i = 0; i < b->tdx; ++i)
+        n += sizeof(struct txn) + 8 * 10 + (size_t)b->tta[i].cdx * 5 * 10;
+
+    return (n);
+}
+
+/*
+ * record layout: tdx, cold data flag and bytes without the journal, then
+ * per txn its scalars as varints, the nonce as a delta from the previous
+ * txn, the byte fields, and per command the function and argument as
+ * deltas from the previous command of the block, kind, state key, group.
+ */
+static size_t tir_pak(struct blk *const b, uint8_t *const o)
+{
+    uint64_t pf, pa, pn, f, a;
+    struct txn *x;
+    uint32_t i, j;
+    uint8_t *p;
+
+    p = tir_pvu(o, b->tdx);
+    *p++ = b->bcd != NULL;
+    if(b->bcd != NULL)
+        p = tir_pby(p, &b->bcd->bfp,
+                    sizeof(struct bcd) - offsetof(struct bcd, bfp));
+
+    pf = pa = pn = 0;
+    for(i = 0; i < b->tdx; ++i) {
+        x = &b->tta[i];
+        p = tir_pvu(p, x->cdx);
+        p = tir_pvu(p, x->sta);
+        p = tir_pvu(p, x->cpt);
+        p = tir_pvu(p, x->fee);
+        p = tir_pvu(p, x->gsl);
+        p = tir_pvu(p, x->gsu);
+        p = tir_pvu(p, x->gsp);
+        p = tir_pvz(p, (int64_t)(x->nce - pn));
+        pn = x->nce;
+        p = tir_pvu(p, x->val);
+        p = tir_pby(p, x->ato, sizeof(x->ato));
+        p = tir_pby(p, x->afr, sizeof(x->afr));
+        p = tir_pby(p, x->hsh, BFL);
+        p = tir_pby(p, x->pbk, BFL);
+        p = tir_pby(p, x->sig, BFL*2);
+        for(j = 0; j < x->cdx; ++j) {
+            f = (uint64_t)*(*(*(x->cmd +j) +0) +0);
+            a = (uint64_t)*(*(*(x->cmd +j) +1) +0);
+            p = tir_pvz(p, (int64_t)(f - pf));
+            p = tir_pvz(p, (int64_t)(a - pa));
+            p = tir_pvu(p, txn_knd(x, j));
+            p = tir_pvu(p, x->str[j]);
+            p = tir_pvu(p, x->gtr[j]);
+            pf = f;
+            pa = a;
+        }
+    }
+
+    return (p - o);
+}
+
+/* rebuild the expanded tables of b from its record */
+static void tir_unp(struct blk *const b, const uint8_t *const p, size_t n)
+{
+    uint64_t pf, pa, pn;
+    struct trd r;
+    struct txn *x;
+    struct txn *t;
+    struct bcd *c;
+    uint32_t d, i, j;
+
+    r.p = p;
+    r.e = p + n;
+    d = mem_own(b);
+    if(tir_gvu(&r) != b->tdx)
+        tir_bad();
+
+    t = (struct txn *)mem_aln(d, sizeof(struct txn) * bcp.tpb);
+    c = NULL;
+    if(r.p >= r.e)
+        tir_bad();
+    if(*r.p++) {
+        c = (struct bcd *)mem_aln(d, sizeof(struct bcd));
+        memset(c, 0, sizeof(struct bcd));
+        tir_gby(&r, &c->bfp, sizeof(struct bcd) - offsetof(struct bcd, bfp));
+    }
+
+    pf = pa = pn = 0;
+    for(i = 0; i < b->tdx; ++i) {
+        x = &t[i];
+        memset(x, 0, sizeof(struct txn));
+        txn_alc(x, d);
+        x->cdx = tir_gvu(&r);
+        x->sta = tir_gvu(&r);
+        if(tir_gvu(&r) != x->cpt || x->cdx > x->cpt)
+            tir_bad();
+        x->fee = tir_gvu(&r);
+        x->gsl = tir_gvu(&r);
+        x->gsu = tir_gvu(&r);
+        x->gsp = tir_gvu(&r);
+        x->nce = pn += tir_gvz(&r);
+        x->val = tir_gvu(&r);
+        tir_gby(&r, x->ato, sizeof(x->ato));
+        tir_gby(&r, x->afr, sizeof(x->afr));
+        tir_gby(&r, x->hsh, BFL);
+        tir_gby(&r, x->pbk, BFL);
+        tir_gby(&r, x->sig, BFL*2);
+        for(j = 0; j < x->cdx; ++j) {
+            pf += tir_gvz(&r);
+            pa += tir_gvz(&r);
+            *(*(*(x->cmd +j) +0) +0) = (void*)pf;
+            *(*(*(x->cmd +j) +1) +0) = (void*)pa;
+            *(*(*(x->cmd +j) +2) +0) = (void*)tir_gvu(&r);
+            x->str[j] = tir_gvu(&r);
+            x->gtr[j] = tir_gvu(&r);
+        }
+    }
+    if(r.p != r.e)
+        tir_bad();
+
+    b->tta = t;
+    b->bcd = c;
+}
+
+/* pack and compress the expanded block of e into its record */
+static void tir_rec(struct tfz *const e)
+{
+    uint8_t *r, *z;
+    size_t rn, zn;
+
+    r = tir_buf(&tir.rbf, &tir.rbm, tir_bnd(e->b));
+    rn = tir_pak(e->b, r);
+    z = tir_buf(&tir.zbf, &tir.zbm, cmp_bnd(rn));
+    zn = cmp_enc(r, rn, z, tir.zbm);
+    if(zn == 0 || rn > UINT32_MAX) {
+        log_err("cannot pack block %u", e->b->bnm);
+        _exit(EXIT_FAILURE);
+    }
+
+    free(e->z);
+    errno = 0;
+    e->z = (uint8_t *)malloc(zn);
+    if(!valid(e->z)) {
+        log_err("!valid(e->z)");
+        _exit(EXIT_FAILURE);
+    }
+    memcpy(e->z, z, zn);
+    tir.sts.raw += rn - e->rn;
+    tir.sts.zsz += zn - e->zn;
+    e->rn = rn;
+    e->zn = zn;
+    e->w = NULL;
+    e->wn = 0;
+}
+
+/* free the expanded tables of a packed block */
+static void tir_drp(struct tfz *const e)
+{
+    struct blk *b;
+    uint32_t i;
+
+    b = e->b;
+    for(i = 0; i < b->tdx; ++i)
+        txn_fre(&b->tta[i]);
+    mem_fre(b->tta, sizeof(struct txn) * bcp.tpb);
+    if(b->bcd != NULL)
+        mem_fre(b->bcd, sizeof(struct bcd));
+    b->tta = NULL;
+    b->bcd = NULL;
+}
+
+static void tir_lru(struct tfz *const e)
+{
+    lst_del_init(&e->lru);
+    e->hot = 0;
+    tir.sts.hot--;
+}
+
+/* a thawed block leaves the lru, packed again since commands write txns */
+static void tir_evc(struct tfz *const e)
+{
+    tir_lru(e);
+    if(e->b->bcd != NULL && e->b->bcd->jnl != NULL) {
+        /* journaled since the thaw, keep it expanded for good */
+        tir.ent[e->b->bnm] = NULL;
+        tir.sts.nfz--;
+        tir.sts.raw -= e->rn;
+        tir.sts.zsz -= e->zn;
+        free(e->z);
+        free(e);
+        return;
+    }
+    tir_rec(e);
+    tir_drp(e);
+    tir.sts.evc++;
+}
+
+/* make room for height h in the entry table */
+static void tir_slt(uint32_t h)
+{
+    struct tfz **n;
+    uint32_t m;
+
+    if(h < tir.nen)
+        return;
+
+    m = tir.nen ? tir.nen : 1024;
+    while(m <= h)
+        m *= 2;
+    errno = 0;
+    n = (struct tfz **)realloc(tir.ent, sizeof(struct tfz *) * m);
+    if(!valid(n)) {
+        log_err("!valid(n)");
+        _exit(EXIT_FAILURE);
+    }
+    memset(n + tir.nen, 0, sizeof(struct tfz *) * (m - tir.nen));
+    tir.ent = n;
+    tir.nen = m;
+}
+
+static int tir_fzl(struct blk *const b)
+{
+    struct tfz *e;
+
+    if(b->tta == NULL)
+        return (1);
+    if(blk_get(b->bnm) != b ||
+       (b->bcd != NULL && (b->bcd->jnl != NULL || b->bcd->pin != 0)))
+        return (0);
+
+    tir_slt(b->bnm);
+    e = tir.ent[b->bnm];
+    if(e != NULL && e->b != b) {
+        /* the height still holds a block reorged out while frozen */
+        if(e->b->tta == NULL)
+            return (0);
+        if(e->hot)
+            tir_lru(e);
+        tir.sts.raw -= e->rn;
+        tir.sts.zsz -= e->zn;
+        tir.sts.nfz--;
+        free(e->z);
+        free(e);
+        e = NULL;
+    }
+    if(e == NULL) {
+        errno = 0;
+        e = (struct tfz *)malloc(sizeof(struct tfz));
+        if(!valid(e)) {
+            log_err("!valid(e)");
+            _exit(EXIT_FAILURE);
+        }
+        memset(e, 0, sizeof(struct tfz));
+        INIT_LST_HEAD(&e->lru);
+        e->b = b;
+        tir.ent[b->bnm] = e;
+        tir.sts.nfz++;
+    }
+    if(e->hot)
+        tir_lru(e);
+
+    tir_rec(e);
+    tir_drp(e);
+
+    return (1);
+}
+
+/* freeze b now, 0 when it has to stay expanded */
+int tir_frz(struct blk *const b)
+{
+    int r;
+
+    if(!valid(b)) {
+        log_err("!valid(b)");
+        _exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&tir.mtx);
+    r = tir_fzl(b);
+    pthread_mutex_unlock(&tir.mtx);
+
+    return (r);
+}
+
+/* t became the tip, the block age below it turns cold */
+void tir_age(struct blk *const t)
+{
+    if(!tir_act() || t->bnm < tir.age)
+        return;
+
+    tir_frz(blk_get(t->bnm - tir.age));
+}
+
+/* freeze every canonical block old enough, returns the number frozen */
+uint32_t tir_swp(void)
+{
+    struct blk *t, *b;
+    uint32_t i, n;
+
+    t = blk_tip();
+    if(!tir_act() || t == NULL || t->bnm < tir.age)
+        return (0);
+
+    n = 0;
+    for(i = 0; i <= t->bnm - tir.age; ++i) {
+        b = blk_get(i);
+        if(b != NULL && b->tta != NULL)
+            n += tir_frz(b);
+    }
+
+    return (n);
+}
+
+/* evict from the cold end down to the cap, skipping k and pinned blocks */
+static void tir_trm(const struct tfz *const k)
+{
+    struct lst_head *i, *n;
+    struct tfz *e;
+
+    for(i = tir.lru.prev; i != &tir.lru && tir.sts.hot > tir.cap; i = n) {
+        n = i->prev;
+        e = lst_entry(i, struct tfz, lru);
+        if(e != k && (e->b->bcd == NULL || e->b->bcd->pin == 0))
+            tir_evc(e);
+    }
+}
+
+/* make the tables of b resident and mark it most recently used, locked */
+static struct tfz* tir_usl(struct blk *const b)
+{
+    struct tfz *e;
+    uint64_t t;
+    uint8_t *r;
+
+    if(b->tta != NULL && b->bnm + tir.age > blk_tip()->bnm)
+        return (NULL);
+
+    e = b->bnm < tir.nen ? tir.ent[b->bnm] : NULL;
+    if(e == NULL || e->b != b) {
+        if(b->tta == NULL) {
+            log_err("frozen block %u has no record", b->bnm);
+            _exit(EXIT_FAILURE);
+        }
+        return (NULL);
+    }
+    if(e->hot) {
+        lst_move(&e->lru, &tir.lru);
+        return (e);
+    }
+
+    t = mtm_get();
+    if(e->w != NULL) {
+        wir_thw(wir_chk(e->w, e->wn), b);
+    } else {
+        r = tir_buf(&tir.rbf, &tir.rbm, e->rn);
+        if(cmp_dec(e->z, e->zn, r, e->rn) != e->rn)
+            tir_bad();
+        tir_unp(b, r, e->rn);
+    }
+    e->hot = 1;
+    lst_add(&e->lru, &tir.lru);
+    tir.sts.hot++;
+    tir.sts.thw++;
+    t = mtm_get() - t;
+    tir.sts.tns += t;
+    if(t > tir.sts.tmx)
+        tir.sts.tmx = t;
+
+    return (e);
+}
+
+/* make the tables of b resident and mark it most recently used */
+void tir_use(struct blk *const b)
+{
+    if(!tir_act())
+        return;
+
+    pthread_mutex_lock(&tir.mtx);
+    tir_trm(tir_usl(b));
+    pthread_mutex_unlock(&tir.mtx);
+}
+
+/*
+ * tir_use that also keeps b expanded until tir_rel: neither aging nor the
+ * lru freezes a pinned block. pins nest.
+ */
+void tir_pin(struct blk *const b)
+{
+    struct tfz *e;
+
+    pthread_mutex_lock(&tir.mtx);
+    e = tir_usl(b);
+    blk_bcd(b)->pin++;
+    tir_trm(e);
+    pthread_mutex_unlock(&tir.mtx);
+}
+
+/* drop a pin of b, the last one lets it freeze if it is old enough */
+void tir_rel(struct blk *const b)
+{
+    struct tfz *e;
+
+    pthread_mutex_lock(&tir.mtx);
+    if(b->bcd == NULL || b->bcd->pin == 0) {
+        pthread_mutex_unlock(&tir.mtx);
+        return;
+    }
+    if(--b->bcd->pin == 0) {
+        e = b->bnm < tir.nen ? tir.ent[b->bnm] : NULL;
+        if(e != NULL && e->b == b && e->hot)
+            tir_trm(NULL);
+        else if(b->bnm + tir.age <= blk_tip()->bnm)
+            tir_fzl(b);
+    }
+    pthread_mutex_unlock(&tir.mtx);
+}
+
+/*
+ * register canonical b, added without tables by blk_cld, as frozen on the
+ * wire record of n bytes at w. the record is only checked on the first
+ * thaw and has to stay mapped while the block is cold.
+ */
+void tir_map(struct blk *const b, const uint8_t *w, uint32_t n)
+{
+    struct tfz *e;
+
+    if(!valid(b) || w == NULL || b->tta != NULL || blk_get(b->bnm) != b) {
+        log_err("block cannot be mapped");
+        _exit(EXIT_FAILURE);
+    }
+
+    errno = 0;
+    e = (struct tfz *)malloc(sizeof(struct tfz));
+    if(!valid(e)) {
+        log_err("!valid(e)");
+        _exit(EXIT_FAILURE);
+    }
+    memset(e, 0, sizeof(struct tfz));
+    INIT_LST_HEAD(&e->lru);
+    e->b = b;
+    e->w = w;
+    e->wn = n;
+
+    pthread_mutex_lock(&tir.mtx);
+    tir_slt(b->bnm);
+    if(tir.ent[b->bnm] != NULL) {
+        pthread_mutex_unlock(&tir.mtx);
+        log_err("height %u is already frozen", b->bnm);
+        _exit(EXIT_FAILURE);
+    }
+    tir.ent[b->bnm] = e;
+    tir.sts.nfz++;
+    pthread_mutex_unlock(&tir.mtx);
+}
+
+/* mapped wire record of b and its length in n, NULL once b was thawed */
+const uint8_t* tir_wir(struct blk *const b, uint32_t *const n)
+{
+    const uint8_t *w;
+    struct tfz *e;
+
+    w = NULL;
+    pthread_mutex_lock(&tir.mtx);
+    e = b->bnm < tir.nen ? tir.ent[b->bnm] : NULL;
+    if(e != NULL && e->b == b && !e->hot && e->w != NULL) {
+        w = e->w;
+        *n = e->wn;
+    }
+    pthread_mutex_unlock(&tir.mtx);
+
+    return (w);
+}
+
+/* a forked child finds the tier unlocked, see ckp.h */
+static void tir_fkl(void)
+{
+    pthread_mutex_lock(&tir.mtx);
+}
+
+static void tir_fku(void)
+{
+    pthread_mutex_unlock(&tir.mtx);
+}
+
+static void tir_fkr(void)
+{
+    pthread_atfork(tir_fkl, tir_fku, tir_fku);
+}
+
+/*
+ * turn the tier on: blocks age below the tip freeze as the chain grows,
+ * at most lru thawed blocks stay expanded. tir_swp freezes what is
+ * already old enough.
+ */
+void tir_ini(uint32_t age, uint32_t lru)
+{
+    pthread_once(&tir_fko, tir_fkr);
+    pthread_mutex_lock(&tir.mtx);
+    tir.age = age ? age : 1;
+    tir.cap = lru < TLM ? TLM : lru;
+    tir_trm(NULL);
+    pthread_mutex_unlock(&tir.mtx);
+    __atomic_store_n(&tir_on, 1, __ATOMIC_RELAXED);
+}
+
+void tir_sta(struct tis *const s)
+{
+    pthread_mutex_lock(&tir.mtx);
+    *s = tir.sts;
+    pthread_mutex_unlock(&tir.mtx);
+}
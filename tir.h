@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * tir.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _TIR_H
+#define _TIR_H
+#include <stdint.h>
+#include <blk.h>
+#include <lst.h>
+
+/*
+ * cold block tier. canonical blocks more than age below the tip are
+ * frozen: txns, commands and cold data are packed into a varint record
+ * with command pointers and nonces delta coded, compressed with cmp.h,
+ * and the expanded tables are freed. the header stays in the chain with
+ * tta and bcd NULL. blk_run, blk_itr, blk_bcd and the hash and wire
+ * paths thaw a frozen block into an lru of at most lru blocks, leaving
+ * the lru packs it again.
+ *
+ * a block loaded from a checkpoint (ckp.h) starts frozen on its mapped
+ * wire record instead, thawed through wir_thw and packed like any other
+ * block when it leaves the lru.
+ *
+ * blocks carrying an undo journal stay expanded. a caller that reads the
+ * tables while other threads may age or thaw blocks pins the block
+ * (tir_pin, through blk_pin) until it is done: aging and the lru skip
+ * pinned blocks, and the last release freezes one that got old. without
+ * a pin a thawed block stays expanded until lru - 1 other blocks were
+ * thawed after it.
+ */
+#define TLM     2
+
+/* a frozen block and its record, or the mapped wire record w of wn bytes */
+struct tfz {
+    struct lst_head lru;
+    struct blk *b;
+    uint8_t *z;
+    const uint8_t *w;
+    uint32_t zn;
+    uint32_t rn;
+    uint32_t wn;
+    uint32_t hot;
+};
+
+struct tis {
+    uint64_t nfz;
+    uint64_t hot;
+    uint64_t thw;
+    uint64_t evc;
+    uint64_t raw;
+    uint64_t zsz;
+    uint64_t tns;
+    uint64_t tmx;
+};
+
+extern uint32_t tir_on;
+
+static inline uint32_t tir_act(void)
+{
+    return (__atomic_load_n(&tir_on, __ATOMIC_RELAXED));
+}
+
+void tir_ini(uint32_t age, uint32_t lru);
+void tir_age(struct blk *const t);
+uint32_t tir_swp(void);
+int tir_frz(struct blk *const b);
+void tir_use(struct blk *const b);
+void tir_pin(struct blk *const b);
+void tir_rel(struct blk *const b);
+void tir_map(struct blk *const b, const uint8_t *w, uint32_t n);
+const uint8_t* tir_wir(struct blk *const b, uint32_t *const n);
+void tir_sta(struct tis *const s);
+
+#endif
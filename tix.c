@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * tix.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <unistd.h>
+#include <tix.h>
+#include <utl.h>
+
+/* first entry with tsm >= t, or x->len */
+uint32_t tix_lwb(const struct tix *const x, uint64_t t)
+{
+    uint32_t l, h, m;
+
+    l = 0;
+    h = x->len;
+    while(l < h) {
+        m = l + ((h - l) >> 1);
+        if(x->ent[m].tsm < t)
+            l = m + 1;
+        else
+            h = m;
+    }
+
+    return (l);
+}
+
+/* first entry with tsm > t, searched backwards from the tail */
+static uint32_t tix_upb(const struct tix *const x, uint64_t t)
+{
+    uint32_t l, h, m, s;
+
+    /* gallop back from the tail, clock steps are usually small */
+    h = x->len;
+    s = 1;
+    while(h > 0 && x->ent[h - 1].tsm > t) {
+        l = h > s ? h - s : 0;
+        if(x->ent[l].tsm <= t)
+            break;
+        h = l;
+        s <<= 1;
+    }
+    l = h > s ? h - s : 0;
+
+    while(l < h) {
+        m = l + ((h - l) >> 1);
+        if(x->ent[m].tsm <= t)
+            l = m + 1;
+        else
+            h = m;
+    }
+
+    return (l);
+}
+
+void tix_add(struct tix *const x, uint64_t t, void *const p)
+{
+    struct tie *e;
+    uint32_t i, n;
+
+    if(x == NULL) {
+        log_err("x is NULL");
+        _exit(EXIT_FAILURE);
+    }
+
+    if(x->len == x->cap) {
+        if(x->cap == UINT32_MAX) {
+            log_err("time index is full");
+            _exit(EXIT_FAILURE);
+        }
+        n = x->cap ? (x->cap > UINT32_MAX / 2 ? UINT32_MAX : x->cap * 2) : 1024;
+        errno = 0;
+        e = (struct tie *)realloc(x->ent, sizeof(struct tie) * n);
+        if(!valid(e)) {
+            log_err("!valid(e)");
+            _exit(EXIT_FAILURE);
+        }
+        x->ent = e;
+        x->cap = n;
+    }
+
+    if(x->len == 0 || x->ent[x->len - 1].tsm <= t) {
+        i = x->len;
+    } else {
+        /* realtime stamp went backwards, keep the index sorted */
+        i = tix_upb(x, t);
+        memmove(&x->ent[i + 1], &x->ent[i],
+                sizeof(struct tie) * (x->len - i));
+    }
+
+    x->ent[i].tsm = t;
+    x->ent[i].p = p;
+    x->len++;
+}
+
+/* remove the entry for p stamped t, if present */
+void tix_del(struct tix *const x, uint64_t t, void *const p)
+{
+    uint32_t i;
+
+    if(x == NULL) {
+        log_err("x is NULL");
+        _exit(EXIT_FAILURE);
+    }
+
+    for(i = tix_lwb(x, t); i < x->len && x->ent[i].tsm == t; ++i) {
+        if(x->ent[i].p == p) {
+            memmove(&x->ent[i], &x->ent[i + 1],
+                    sizeof(struct tie) * (x->len - i - 1));
+            x->len--;
+            return;
+        }
+    }
+}
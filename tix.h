@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * tix.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _TIX_H
+#define _TIX_H
+#include <stdint.h>
+
+struct tie {
+    uint64_t tsm;
+    void *p;
+};
+
+/*
+ * timestamp index: entries sorted by tsm, appended in O(1) while stamps
+ * are monotonic and inserted near the tail when the realtime clock steps
+ * back. lookups are a binary search, range walks are O(log n + k).
+ */
+struct tix {
+    struct tie *ent;
+    uint32_t cap;
+    uint32_t len;
+};
+
+#define TIX_INIT { NULL, 0, 0 }
+
+void tix_add(struct tix *const x, uint64_t t, void *const p);
+void tix_del(struct tix *const x, uint64_t t, void *const p);
+uint32_t tix_lwb(const struct tix *const x, uint64_t t);
+
+#endif
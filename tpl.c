@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * tpl.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <unistd.h>
+#include <tpl.h>
+#include <utl.h>
+
+static void tpq_ini(struct tpq *const q)
+{
+    q->cap = 256;
+    errno = 0;
+    q->q = (struct tsk *)malloc(sizeof(struct tsk) * q->cap);
+    if(!valid(q->q)) {
+        log_err("!valid(q->q)");
+        _exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&q->mtx, NULL);
+    pthread_cond_init(&q->cnd, NULL);
+}
+
+/* take the oldest task of q into t, q->mtx held; 0 when q is empty */
+static int tpq_pop(struct tpl *const p, struct tpq *const q, struct tsk *t)
+{
+    if(q->cnt == 0)
+        return (0);
+
+    *t = q->q[q->hd];
+    q->hd = (q->hd + 1) % q->cap;
+    q->cnt--;
+    __atomic_sub_fetch(&p->cnt, 1, __ATOMIC_SEQ_CST);
+
+    return (1);
+}
+
+static void* tpl_run(void *a)
+{
+    struct tpl *p;
+    struct tpq *q, *v;
+    struct tsk t;
+    uint32_t d, k;
+    int g;
+
+    p = (struct tpl *)a;
+    pthread_mutex_lock(&p->mtx);
+    d = p->nxt++ % p->nnd;
+    pthread_mutex_unlock(&p->mtx);
+    if(p->nnd > 1)
+        mem_pin(d);
+
+    /* idl is raised before cnt is read, tpl_pun raises cnt before idl */
+    q = &p->nq[d];
+    pthread_mutex_lock(&q->mtx);
+    while(1) {
+        __atomic_add_fetch(&q->idl, 1, __ATOMIC_SEQ_CST);
+        while(__atomic_load_n(&p->cnt, __ATOMIC_SEQ_CST) == 0 &&
+              !__atomic_load_n(&p->stp, __ATOMIC_SEQ_CST))
+            pthread_cond_wait(&q->cnd, &q->mtx);
+        __atomic_sub_fetch(&q->idl, 1, __ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&p->cnt, __ATOMIC_SEQ_CST) == 0)
+            break;
+
+        /* own node first, then steal from the nearest in ring order */
+        g = tpq_pop(p, q, &t);
+        pthread_mutex_unlock(&q->mtx);
+        for(k = 1; !g && k < p->nnd; ++k) {
+            v = &p->nq[(d + k) % p->nnd];
+            pthread_mutex_lock(&v->mtx);
+            g = tpq_pop(p, v, &t);
+            pthread_mutex_unlock(&v->mtx);
+            if(g)
+                __atomic_add_fetch(&p->stl, 1, __ATOMIC_RELAXED);
+        }
+
+        if(g) {
+            t.fn(t.a);
+            /* tasks queued by t were counted before t finished */
+            if(__atomic_sub_fetch(&p->pnd, 1, __ATOMIC_ACQ_REL) == 0) {
+                pthread_mutex_lock(&p->mtx);
+                pthread_cond_broadcast(&p->dne);
+                pthread_mutex_unlock(&p->mtx);
+            }
+        }
+        pthread_mutex_lock(&q->mtx);
+    }
+    pthread_mutex_unlock(&q->mtx);
+
+    return (NULL);
+}
+
+struct tpl* tpl_new(uint32_t n)
+{
+    struct tpl *p;
+    uint32_t i;
+
+    if(n == 0) {
+        log_err("n == 0");
+        _exit(EXIT_FAILURE);
+    }
+
+    errno = 0;
+    p = (struct tpl *)calloc(1, sizeof(struct tpl));
+    if(!valid(p)) {
+        log_err("!valid(p)");
+        _exit(EXIT_FAILURE);
+    }
+
+    errno = 0;
+    p->thr = (pthread_t *)malloc(sizeof(pthread_t) * n);
+    if(!valid(p->thr)) {
+        log_err("!valid(p->thr)");
+        _exit(EXIT_FAILURE);
+    }
+
+    p->nnd = mem_nnd();
+    for(i = 0; i < p->nnd; ++i)
+        tpq_ini(&p->nq[i]);
+    pthread_mutex_init(&p->mtx, NULL);
+    pthread_cond_init(&p->dne, NULL);
+
+    for(i = 0; i < n; ++i) {
+        errno = pthread_create(&p->thr[i], NULL, tpl_run, p);
+        if(errno != 0) {
+            log_err("pthread_create()");
+            _exit(EXIT_FAILURE);
+        }
+    }
+    p->nth = n;
+
+    return (p);
+}
+
+/* queue fn on the node of the calling thread */
+void tpl_put(struct tpl *const p, tfn_t fn, void *a)
+{
+    tpl_pun(p, mem_nod(), fn, a);
+}
+
+/* queue fn on node d, waking a worker elsewhere if d has none idle */
+void tpl_pun(struct tpl *const p, uint32_t d, tfn_t fn, void *a)
+{
+    struct tpq *q;
+    struct tsk *n;
+    uint32_t i, k;
+
+    if(!valid(p) || fn == NULL) {
+        log_err("!valid(p) || fn == NULL");
+        _exit(EXIT_FAILURE);
+    }
+
+    d %= p->nnd;
+    q = &p->nq[d];
+    __atomic_add_fetch(&p->pnd, 1, __ATOMIC_ACQ_REL);
+    pthread_mutex_lock(&q->mtx);
+    if(q->cnt == q->cap) {
+        /* unwrap the ring into a buffer twice the size */
+        errno = 0;
+        n = (struct tsk *)malloc(sizeof(struct tsk) * q->cap * 2);
+        if(!valid(n)) {
+            log_err("!valid(n)");
+            _exit(EXIT_FAILURE);
+        }
+        for(i = 0; i < q->cnt; ++i)
+            n[i] = q->q[(q->hd + i) % q->cap];
+        free(q->q);
+        q->q = n;
+        q->hd = 0;
+        q->cap *= 2;
+    }
+    q->q[(q->hd + q->cnt) % q->cap].fn = fn;
+    q->q[(q->hd + q->cnt) % q->cap].a = a;
+    q->cnt++;
+    __atomic_add_fetch(&p->cnt, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&q->mtx);
+
+    /* an idle worker waits under its ring's lock, signal it under that lock */
+    for(k = 0; k < p->nnd; ++k) {
+        q = &p->nq[(d + k) % p->nnd];
+        if(__atomic_load_n(&q->idl, __ATOMIC_SEQ_CST) != 0) {
+            pthread_mutex_lock(&q->mtx);
+            pthread_cond_signal(&q->cnd);
+            pthread_mutex_unlock(&q->mtx);
+            break;
+        }
+    }
+}
+
+/* wait until every queued task, and every task they queued, has run */
+void tpl_wait(struct tpl *const p)
+{
+    if(!valid(p)) {
+        log_err("!valid(p)");
+        _exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&p->mtx);
+    while(__atomic_load_n(&p->pnd, __ATOMIC_ACQUIRE) != 0)
+        pthread_cond_wait(&p->dne, &p->mtx);
+    pthread_mutex_unlock(&p->mtx);
+}
+
+void tpl_del(struct tpl *const p)
+{
+    uint32_t i;
+
+    if(!valid(p))
+        return;
+
+    pthread_mutex_lock(&p->mtx);
+    __atomic_store_n(&p->stp, 1, __ATOMIC_SEQ_CST);
+    for(i = 0; i < p->nnd; ++i) {
+        pthread_mutex_lock(&p->nq[i].mtx);
+        pthread_cond_broadcast(&p->nq[i].cnd);
+        pthread_mutex_unlock(&p->nq[i].mtx);
+    }
+    pthread_mutex_unlock(&p->mtx);
+
+    for(i = 0; i < p->nth; ++i)
+        pthread_join(p->thr[i], NULL);
+
+    for(i = 0; i < p->nnd; ++i) {
+        pthread_mutex_destroy(&p->nq[i].mtx);
+        pthread_cond_destroy(&p->nq[i].cnd);
+        free(p->nq[i].q);
+    }
+    pthread_mutex_destroy(&p->mtx);
+    pthread_cond_destroy(&p->dne);
+    free(p->thr);
+    free(p);
+}
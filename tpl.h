@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * tpl.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _TPL_H
+#define _TPL_H
+#include <pthread.h>
+#include <stdint.h>
+#include <mem.h>
+
+typedef void (*tfn_t)(void *a);
+
+struct tsk {
+    tfn_t fn;
+    void *a;
+};
+
+/* growable task ring, mtx guards the ring and the sleep on cnd */
+struct tpq {
+    struct tsk *q;
+    uint32_t cap;
+    uint32_t hd;
+    uint32_t cnt;
+    uint32_t idl;
+    pthread_mutex_t mtx;
+    pthread_cond_t cnd;
+};
+
+/*
+ * fixed size worker pool with one task ring per memory node (mem.h).
+ * workers are spread over the nodes and, with the numa backend, pinned to
+ * them. a worker drains its own node's ring and steals from the others
+ * only when that is empty. each ring has its own lock; cnt, pnd and stp
+ * are atomic, and mtx only serializes tpl_wait and shutdown.
+ */
+struct tpl {
+    pthread_t *thr;
+    struct tpq nq[MND];
+    uint32_t nth;
+    uint32_t nnd;
+    uint32_t cnt;
+    uint32_t pnd;
+    uint32_t stp;
+    uint32_t nxt;
+    uint64_t stl;
+    pthread_mutex_t mtx;
+    pthread_cond_t dne;
+};
+
+struct tpl* tpl_new(uint32_t n);
+void tpl_put(struct tpl *const p, tfn_t fn, void *a);
+void tpl_pun(struct tpl *const p, uint32_t d, tfn_t fn, void *a);
+void tpl_wait(struct tpl *const p);
+void tpl_del(struct tpl *const p);
+
+#endif
@@ -7,8 +7,13 @@
  */
 
 #include <blk.h>
+#include <evl.h>
+#include <prf.h>
+#include <rng.h>
 #include <utl.h>
 #include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
 #include <signal.h>
 
 void tst(uint64_t t)
@@ -45,13 +50,150 @@ void tstd(uint8_t u)
 
 enum {CTA, CTB, CTC};
 
-int main(int argc, char **argv)
+/* queued txns */
+#define TQL     1024
+
+/* a txn handed from a producer thread to the loop */
+struct ptx {
+    fcnt_t fn[3];
+    uint64_t arg;
+};
+
+struct tsd {
+    struct evl *e;
+    struct rng q;
+    struct blk *b;
+    const char *sts;
+    pthread_t thr;
+    uint64_t rat;
+    uint64_t max;
+    uint64_t nbk;
+    uint64_t drp;
+    uint32_t stp;
+};
+
+static uint64_t mtm_get(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return tp.tv_sec*1000000000UL + tp.tv_nsec;
+}
+
+/* submit rat txns a second and poke the loop for each */
+static void* tst_prd(void *a)
+{
+    struct timespec t;
+    struct tsd *d;
+    struct ptx *x;
+    uint64_t n;
+
+    d = (struct tsd *)a;
+    n = mtm_get();
+    while(!__atomic_load_n(&d->stp, __ATOMIC_ACQUIRE)) {
+        errno = 0;
+        x = (struct ptx *)malloc(sizeof(struct ptx));
+        if(!valid(x)) {
+            log_err("!valid(x)");
+            _exit(EXIT_FAILURE);
+        }
+        x->fn[0] = (fcnt_t)&tst;
+        x->fn[1] = (fcnt_t)&tsta;
+        x->fn[2] = (fcnt_t)&tstb;
+        x->arg = CTB;
+        if(!rng_put(&d->q, x)) {
+            free(x);
+            __atomic_add_fetch(&d->drp, 1, __ATOMIC_RELAXED);
+        }
+        evl_wak(d->e);
+
+        n += 1000000000UL / d->rat;
+        t.tv_sec = n / 1000000000UL;
+        t.tv_nsec = n % 1000000000UL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+    }
+
+    return (NULL);
+}
+
+/* move queued txns into the open block */
+static void tst_drn(struct evl *const e, void *a)
+{
+    struct tsd *d;
+    struct ptx *x;
+    uint32_t i;
+
+    d = (struct tsd *)a;
+    while(d->b->tdx < bcp.tpb - 1 && (x = (struct ptx *)rng_get(&d->q)) != NULL) {
+        txn_add(d->b);
+        for(i = 0; i < 3; ++i)
+            txn_addcmd(d->b, x->fn[i], 0, x->arg);
+        free(x);
+    }
+}
+
+/* timer tick: seal the open block and open the next one */
+static void tst_sel(struct evl *const e, void *a)
+{
+    struct tsd *d;
+
+    d = (struct tsd *)a;
+    tst_drn(e, a);
+    blk_run(d->b);
+    blk_hsh(d->b);
+    blk_sel(d->b);
+    log_dbg("%u %u %lu", d->b->bnm, d->b->tdx, d->b->tsm);
+    if(++d->nbk == d->max) {
+        evl_stp(e);
+        return;
+    }
+    d->b = blk_add(d->b);
+}
+
+/* block interval statistics to the stats file, or syslog without one */
+static void tst_exp(struct tsd *const d)
+{
+    const struct ejt *j;
+    double m, s;
+    FILE *f;
+
+    j = &d->e->jit;
+    m = j->cnt ? (double)j->jsm / j->cnt / 1000.0 : 0;
+    s = j->cnt ? sqrt(fmax((double)j->jsq / j->cnt - m * m, 0)) : 0;
+    if(d->sts == NULL) {
+        log_inf("blocks %lu jitter mean %.1f sd %.1f max %.1f us "
+                "latency mean %.1f max %.1f us missed %lu dropped %lu",
+                d->nbk, m, s, j->jmx / 1000.0,
+                j->cnt ? (double)j->lsm / j->cnt / 1000.0 : 0,
+                j->lmx / 1000.0, j->mis, d->drp);
+        return;
+    }
+
+    f = fopen(d->sts, "w");
+    if(f == NULL) {
+        log_wrn("cannot write %s", d->sts);
+        return;
+    }
+    fprintf(f, "blocks %lu\njitter_mean_us %.1f\njitter_sd_us %.1f\n"
+            "jitter_max_us %.1f\nlatency_mean_us %.1f\nlatency_max_us %.1f\n"
+            "missed %lu\ndropped %lu\n", d->nbk, m, s, j->jmx / 1000.0,
+            j->cnt ? (double)j->lsm / j->cnt / 1000.0 : 0, j->lmx / 1000.0,
+            j->mis, d->drp);
+    fclose(f);
+}
+
+static void tst_sig(struct evl *const e, void *a)
+{
+    if(e->sig == SIGHUP || e->sig == SIGUSR1) {
+        tst_exp((struct tsd *)a);
+        prf_rep();
+    }
+}
+
+static void tst_dmn(void)
 {
     uint32_t i, m;
     struct sigaction sa;
-    struct timespec req, rem;
-    struct blk *b, *r;
-    static const time_t ssc = 1;
 
     switch(fork()) {
     case -1:
@@ -97,34 +239,93 @@ int main(int argc, char **argv)
         _exit(EXIT_FAILURE);
     if (dup2(STDIN_FILENO, STDERR_FILENO) != STDERR_FILENO)
         _exit(EXIT_FAILURE);
+}
 
-    b = blk_add(INIT);
-    if(!valid(b))
-        _exit(EXIT_FAILURE);
-    txn_add(b);
-    txn_addcmd(b,(fcnt_t)&tst,0,CTB);
-    txn_addcmd(b,(fcnt_t)&tsta,0,CTB);
-    txn_addcmd(b,(fcnt_t)&tstb,0,CTB);
-    r = b;
-    openlog("bcn", LOG_PID, LOG_DAEMON);
+/*
+ * usage: tst [-f] [-i interval_ms] [-n blocks] [-r txns_per_s] [-s file]
+ *            [-p file]
+ * -f stays in the foreground, -n stops after that many blocks. SIGHUP or
+ * SIGUSR1 export block interval stats to the -s file or syslog and the
+ * -p counter profile (prf.h), SIGINT and SIGTERM export them and exit.
+ */
+int main(int argc, char **argv)
+{
+    const char *prf;
+    struct tsd d;
+    uint64_t ivl;
+    int o, fg;
 
-    for(i = 0; i < 400; ++i) {
-        b = blk_add(b);
-        txn_add(b);
-        txn_addcmd(b,(fcnt_t)&tst,0,CTB);
-        txn_addcmd(b,(fcnt_t)&tsta,0,CTB);
-        txn_addcmd(b,(fcnt_t)&tstb,0,CTB);
-        if(!valid(b)) {
-            log_err("b==NULL");
+    memset(&d, 0, sizeof(d));
+    prf = NULL;
+    ivl = 1000;
+    d.rat = 1;
+    fg = 0;
+    while((o = getopt(argc, argv, "fi:n:p:r:s:")) != -1) {
+        switch(o) {
+        case 'f':
+            fg = 1;
+            break;
+        case 'i':
+            ivl = strtoull(optarg, NULL, 10);
+            break;
+        case 'n':
+            d.max = strtoull(optarg, NULL, 10);
+            break;
+        case 'r':
+            d.rat = strtoull(optarg, NULL, 10);
+            break;
+        case 'p':
+            prf = optarg;
+            break;
+        case 's':
+            d.sts = optarg;
+            break;
+        default:
             _exit(EXIT_FAILURE);
         }
     }
+    if(ivl == 0 || d.rat == 0)
+        _exit(EXIT_FAILURE);
+
+    if(!fg)
+        tst_dmn();
+    openlog("bcn", LOG_PID, LOG_DAEMON);
+    opc_reg((fcnt_t)&tst);
+    opc_reg((fcnt_t)&tsta);
+    opc_reg((fcnt_t)&tstb);
+    if(prf != NULL && prf_ini(prf) == 0)
+        log_wrn("no hardware counters, profiling time only");
 
-    blk_itr(r);
-    req.tv_sec = ssc;
-    req.tv_nsec = 0;
-    while(1) {
-        nanosleep(&req, &rem);
-        log_dbg("%ld",tsm_get());
+    d.b = blk_add(INIT);
+    if(!valid(d.b))
+        _exit(EXIT_FAILURE);
+    txn_add(d.b);
+    txn_addcmd(d.b,(fcnt_t)&tst,0,CTB);
+    txn_addcmd(d.b,(fcnt_t)&tsta,0,CTB);
+    txn_addcmd(d.b,(fcnt_t)&tstb,0,CTB);
+
+    /* the loop blocks the signals before the producer inherits the mask */
+    d.e = evl_new(EVL_SIG);
+    rng_ini(&d.q, TQL);
+    evl_onw(d.e, tst_drn, &d);
+    evl_ons(d.e, tst_sig, &d);
+    evl_tmr(d.e, ivl * 1000000UL, tst_sel, &d);
+
+    errno = pthread_create(&d.thr, NULL, tst_prd, &d);
+    if(errno != 0) {
+        log_err("pthread_create()");
+        _exit(EXIT_FAILURE);
     }
+
+    evl_run(d.e);
+
+    __atomic_store_n(&d.stp, 1, __ATOMIC_RELEASE);
+    pthread_join(d.thr, NULL);
+    tst_exp(&d);
+    prf_rep();
+    evl_del(d.e);
+    rng_fre(&d.q);
+    closelog();
+
+    return (EXIT_SUCCESS);
 }
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * vec.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <unistd.h>
+#include <vec.h>
+#include <utl.h>
+
+void vec_add(struct vec *const v, void *const p)
+{
+    void ***d;
+    uint32_t c, n;
+
+    if(v == NULL) {
+        log_err("v is NULL");
+        _exit(EXIT_FAILURE);
+    }
+
+    if(v->len == UINT32_MAX) {
+        log_err("vector is full");
+        _exit(EXIT_FAILURE);
+    }
+
+    c = v->len >> VCB;
+    if(c >= v->nch) {
+        /* grow the chunk directory only, chunks stay in place */
+        n = v->nch ? v->nch * 2 : 16;
+        errno = 0;
+        d = (void ***)realloc(v->chk, sizeof(void **) * n);
+        if(!valid(d)) {
+            log_err("!valid(d)");
+            _exit(EXIT_FAILURE);
+        }
+        memset(d + v->nch, 0, sizeof(void **) * (n - v->nch));
+        v->chk = d;
+        v->nch = n;
+    }
+
+    if(v->chk[c] == NULL) {
+        errno = 0;
+        v->chk[c] = (void **)malloc(sizeof(void *) * VCS);
+        if(!valid(v->chk[c])) {
+            log_err("!valid(v->chk[c])");
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    v->chk[c][v->len & VCM] = p;
+    v->len++;
+}
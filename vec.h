@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * vec.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _VEC_H
+#define _VEC_H
+#include <stdint.h>
+
+#define VCB     12
+#define VCS     (1U << VCB)
+#define VCM     (VCS - 1)
+
+/*
+ * chunked append-only pointer vector: chunks never move once allocated,
+ * so element addresses stay stable while the directory grows.
+ */
+struct vec {
+    void ***chk;
+    uint32_t nch;
+    uint32_t len;
+};
+
+#define VEC_INIT { NULL, 0, 0 }
+
+void vec_add(struct vec *const v, void *const p);
+
+/* drop elements from n on, chunks are kept for reuse */
+static inline void vec_cut(struct vec *const v, uint32_t n)
+{
+
+    if(n < v->len)
+        v->len = n;
+}
+
+static inline void *vec_get(const struct vec *const v, uint32_t i)
+{
+
+    return v->chk[i >> VCB][i & VCM];
+}
+
+/* replace element i < len */
+static inline void vec_put(struct vec *const v, uint32_t i, void *const p)
+{
+
+    v->chk[i >> VCB][i & VCM] = p;
+}
+
+static inline uint32_t vec_len(const struct vec *const v)
+{
+
+    return v->len;
+}
+
+#endif
@@ -0,0 +1,374 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * wir.c
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#include <wir.h>
+#include <crt.h>
+#include <mem.h>
+#include <opc.h>
+#include <sha.h>
+#include <utl.h>
+
+/* encoded size of b */
+uint32_t wir_siz(struct blk *const b)
+{
+    uint64_t n;
+    uint32_t i;
+
+    if(!valid(b)) {
+        log_err("!valid(b)");
+        _exit(EXIT_FAILURE);
+    }
+
+    blk_pin(b);
+    n = sizeof(struct wbh) + WAL_UP(sizeof(uint32_t) * b->tdx);
+    for(i = 0; i < b->tdx; ++i)
+        n += wir_tsz(&b->tta[i]);
+    blk_rel(b);
+    if(n > UINT32_MAX) {
+        log_err("block record too large");
+        _exit(EXIT_FAILURE);
+    }
+
+    return (n);
+}
+
+/* encoded size of a standalone txn record */
+uint32_t wir_tsz(struct txn *const x)
+{
+    return (sizeof(struct wtx) + sizeof(struct wcm) * x->cdx);
+}
+
+/*
+ * encode x at the 8 byte aligned o, returns the record length. every
+ * command must be a registered opcode, see opc.h
+ */
+uint32_t wir_etx(struct txn *const x, uint8_t *const o)
+{
+    struct wtx *t;
+    struct wcm *c;
+    uint32_t j, p;
+
+    t = (struct wtx *)o;
+    memset(t, 0, sizeof(*t));
+    t->len = htole32(wir_tsz(x));
+    t->cdx = htole32(x->cdx);
+    t->fee = htole32(x->fee);
+    t->gsl = htole32(x->gsl);
+    t->gsu = htole32(x->gsu);
+    t->gsp = htole32(x->gsp);
+    t->sta = htole16(x->sta);
+    t->cmo = htole32(sizeof(struct wtx));
+    t->nce = htole64(x->nce);
+    t->val = htole64(x->val);
+    memcpy(t->ato, x->ato, sizeof(t->ato));
+    memcpy(t->afr, x->afr, sizeof(t->afr));
+    memcpy(t->hsh, x->hsh, BFL);
+    memcpy(t->pbk, x->pbk, BFL);
+    memcpy(t->sig, x->sig, BFL*2);
+
+    c = (struct wcm *)(t + 1);
+    for(j = 0; j < x->cdx; ++j) {
+        /* a record naming no opcode could never be decoded */
+        p = opc_get((fcnt_t)*(*(*(x->cmd +j) +0) +0));
+        if(p == OPX) {
+            log_err("command %u is not a registered opcode", j);
+            _exit(EXIT_FAILURE);
+        }
+        c[j].arg = htole64((uint64_t)*(*(*(x->cmd +j) +1) +0));
+        c[j].opc = htole32(p);
+        c[j].str = htole32(x->str[j]);
+        c[j].gtr = htole32(x->gtr[j]);
+        c[j].knd = htole32(txn_knd(x, j));
+    }
+
+    return (wle32(t->len));
+}
+
+/* fill the block header of a record of z bytes */
+void wir_ehd(struct blk *const b, struct wbh *const h, uint32_t z)
+{
+    struct bcd *d;
+
+    d = blk_bcd(b);
+    memset(h, 0, sizeof(*h));
+    h->mag = htole32(WMG);
+    h->len = htole32(z);
+    h->ver = htole32(WVR);
+    h->bnm = htole32(b->bnm);
+    h->tsm = htole64(b->tsm);
+    h->tdf = htole64(b->tdf);
+    h->tdx = htole32(b->tdx);
+    h->txo = htole32(sizeof(struct wbh));
+    memcpy(h->psh, d->psh, BFL);
+    memcpy(h->msh, d->msh, BFL);
+    memcpy(h->trh, d->trh, BFL);
+    memcpy(h->srh, d->srh, BFL);
+    memcpy(h->rrh, d->rrh, BFL);
+}
+
+/* encode b into o, returns the record length or 0 when n is too small */
+uint32_t wir_enc(struct blk *const b, uint8_t *const o, uint32_t n)
+{
+    struct wbh *h;
+    uint32_t *off, i, p, z;
+
+    z = wir_siz(b);
+    if(z > n || ((uintptr_t)o & (WAL - 1)))
+        return (0);
+
+    blk_pin(b);
+    h = (struct wbh *)o;
+    wir_ehd(b, h, z);
+
+    off = (uint32_t *)(o + sizeof(struct wbh));
+    p = sizeof(struct wbh) + WAL_UP(sizeof(uint32_t) * b->tdx);
+    memset(off, 0, p - sizeof(struct wbh));
+    for(i = 0; i < b->tdx; ++i) {
+        off[i] = htole32(p);
+        p += wir_etx(&b->tta[i], o + p);
+    }
+    blk_rel(b);
+
+    return (p);
+}
+
+/* bounds check a record of at most n bytes at p, NULL when malformed */
+const struct wbh* wir_chk(const uint8_t *const p, uint32_t n)
+{
+    const struct wbh *h;
+    const struct wtx *t;
+    const uint32_t *off;
+    uint64_t e;
+    uint32_t i, l, d, o;
+
+    if(p == NULL || ((uintptr_t)p & (WAL - 1)) || n < sizeof(struct wbh))
+        return (NULL);
+
+    h = (const struct wbh *)p;
+    l = wle32(h->len);
+    d = wle32(h->tdx);
+    if(wle32(h->mag) != WMG || wle32(h->ver) != WVR || l > n ||
+       l < sizeof(struct wbh) || d >= bcp.tpb)
+        return (NULL);
+
+    o = wle32(h->txo);
+    if((o & (WAL - 1)) || (uint64_t)o + sizeof(uint32_t) * d > l)
+        return (NULL);
+
+    off = (const uint32_t *)(p + o);
+    for(i = 0; i < d; ++i) {
+        o = wle32(off[i]);
+        if((o & (WAL - 1)) || (uint64_t)o + sizeof(struct wtx) > l)
+            return (NULL);
+        t = (const struct wtx *)(p + o);
+        if(wle32(t->cdx) > bcp.cpt || (wle32(t->cmo) & (WAL - 1)))
+            return (NULL);
+        e = (uint64_t)o + wle32(t->cmo) + sizeof(struct wcm) * wle32(t->cdx);
+        if(wle32(t->cmo) < sizeof(struct wtx) || e > l)
+            return (NULL);
+    }
+
+    return (h);
+}
+
+/*
+ * rebuild a checked record as a child of l through the normal blk_add,
+ * txn_add and txn_addcmd path. NULL when it names an unknown opcode or
+ * its difficulty does not exceed the parent's.
+ */
+struct blk* wir_dec(const struct wbh *const h, struct blk *const l)
+{
+    const struct wtx *t;
+    const struct wcm *c;
+    struct blk *b;
+    struct bcd *d;
+    struct txn *x;
+    uint64_t p;
+    uint32_t i, j, n;
+
+    if(h == NULL) {
+        log_err("h is NULL");
+        _exit(EXIT_FAILURE);
+    }
+
+    p = l != INIT ? l->tdf : 0;
+    if(wle64(h->tdf) <= p)
+        return (NULL);
+
+    n = wle32(h->tdx);
+    for(i = 0; i < n; ++i) {
+        t = wir_txn(h, i);
+        for(j = 0; j < wle32(t->cdx); ++j)
+            if(opc_fn(wle32(wir_cmd(t, j)->opc)) == NULL ||
+               wle32(wir_cmd(t, j)->knd) > CMK_CRT)
+                return (NULL);
+    }
+
+    b = blk_addt(l, wle64(h->tsm));
+    if(wle64(h->tdf) != b->tdf)
+        blk_dif(b, wle64(h->tdf) - p);
+
+    d = blk_bcd(b);
+    memcpy(d->psh, h->psh, BFL);
+    memcpy(d->msh, h->msh, BFL);
+    memcpy(d->trh, h->trh, BFL);
+    memcpy(d->srh, h->srh, BFL);
+    memcpy(d->rrh, h->rrh, BFL);
+
+    for(i = 0; i < n; ++i) {
+        t = wir_txn(h, i);
+        txn_add(b);
+        x = &b->tta[b->tdx-1];
+        x->fee = wle32(t->fee);
+        x->gsl = wle32(t->gsl);
+        x->gsu = wle32(t->gsu);
+        x->gsp = wle32(t->gsp);
+        x->sta = le16toh(t->sta);
+        x->nce = wle64(t->nce);
+        x->val = wle64(t->val);
+        memcpy(x->ato, t->ato, sizeof(x->ato));
+        memcpy(x->afr, t->afr, sizeof(x->afr));
+        memcpy(x->hsh, t->hsh, BFL);
+        memcpy(x->pbk, t->pbk, BFL);
+        memcpy(x->sig, t->sig, BFL*2);
+        for(j = 0; j < wle32(t->cdx); ++j) {
+            c = wir_cmd(t, j);
+            if(wle32(c->knd) == CMK_CRT)
+                txn_addcrt(b, (cfn_t)opc_fn(wle32(c->opc)), wle64(c->arg),
+                           wle32(c->str), wle32(c->gtr));
+            else
+                txn_addcmdk(b, opc_fn(wle32(c->opc)), NULL, wle64(c->arg),
+                            wle32(c->str), wle32(c->gtr));
+        }
+    }
+
+    return (b);
+}
+
+/*
+ * expand frozen b in place from its checked record, for records the cold
+ * tier maps instead of packing (tir_map). the tables go on the node that
+ * holds b and replace tta and bcd only once complete.
+ */
+void wir_thw(const struct wbh *const h, struct blk *const b)
+{
+    const struct wtx *w;
+    const struct wcm *c;
+    struct txn *t, *x;
+    struct bcd *d;
+    fcnt_t f;
+    uint32_t i, j, n, o;
+
+    if(h == NULL || !valid(b) || wle32(h->bnm) != b->bnm ||
+       wle32(h->tdx) != b->tdx) {
+        log_err("record does not match block %u", b->bnm);
+        _exit(EXIT_FAILURE);
+    }
+
+    o = mem_own(b);
+    n = wle32(h->tdx);
+    t = (struct txn *)mem_aln(o, sizeof(struct txn) * bcp.tpb);
+    for(i = 0; i < n; ++i) {
+        w = wir_txn(h, i);
+        x = &t[i];
+        memset(x, 0, sizeof(struct txn));
+        txn_alc(x, o);
+        x->cdx = wle32(w->cdx);
+        x->fee = wle32(w->fee);
+        x->gsl = wle32(w->gsl);
+        x->gsu = wle32(w->gsu);
+        x->gsp = wle32(w->gsp);
+        x->sta = le16toh(w->sta);
+        x->nce = wle64(w->nce);
+        x->val = wle64(w->val);
+        memcpy(x->ato, w->ato, sizeof(x->ato));
+        memcpy(x->afr, w->afr, sizeof(x->afr));
+        memcpy(x->hsh, w->hsh, BFL);
+        memcpy(x->pbk, w->pbk, BFL);
+        memcpy(x->sig, w->sig, BFL*2);
+        for(j = 0; j < x->cdx; ++j) {
+            c = wir_cmd(w, j);
+            f = opc_fn(wle32(c->opc));
+            if(f == NULL || wle32(c->knd) > CMK_CRT) {
+                log_err("block %u names an unknown opcode", b->bnm);
+                _exit(EXIT_FAILURE);
+            }
+            *(*(*(x->cmd +j) +0) +0) = (void*)f;
+            *(*(*(x->cmd +j) +1) +0) = (void*)wle64(c->arg);
+            *(*(*(x->cmd +j) +2) +0) = (void*)(uintptr_t)wle32(c->knd);
+            x->str[j] = wle32(c->str);
+            x->gtr[j] = wle32(c->gtr);
+        }
+    }
+
+    d = (struct bcd *)mem_aln(o, sizeof(struct bcd));
+    memset(d, 0, sizeof(struct bcd));
+    memcpy(d->psh, h->psh, BFL);
+    memcpy(d->msh, h->msh, BFL);
+    memcpy(d->trh, h->trh, BFL);
+    memcpy(d->srh, h->srh, BFL);
+    memcpy(d->rrh, h->rrh, BFL);
+
+    b->tta = t;
+    b->bcd = d;
+}
+
+/*
+ * rehash the txns of a checked record and compare their root with trh,
+ * before anything is linked. 1 when they match, 0 when not.
+ */
+int wir_trc(const struct wbh *const h)
+{
+    const struct wtx *w;
+    struct txn x;
+    struct sha s;
+    fcnt_t f;
+    uint8_t r[BFL];
+    uint32_t i, j, n;
+
+    if(h == NULL) {
+        log_err("h is NULL");
+        _exit(EXIT_FAILURE);
+    }
+
+    memset(&x, 0, sizeof(x));
+    txn_alc(&x, mem_nod());
+    n = wle32(h->tdx);
+    sha_ini(&s);
+    for(i = 0; i < n; ++i) {
+        w = wir_txn(h, i);
+        x.cdx = wle32(w->cdx);
+        x.fee = wle32(w->fee);
+        x.gsl = wle32(w->gsl);
+        x.gsp = wle32(w->gsp);
+        x.nce = wle64(w->nce);
+        x.val = wle64(w->val);
+        memcpy(x.ato, w->ato, sizeof(x.ato));
+        memcpy(x.afr, w->afr, sizeof(x.afr));
+        memcpy(x.pbk, w->pbk, BFL);
+        for(j = 0; j < x.cdx; ++j) {
+            f = opc_fn(wle32(wir_cmd(w, j)->opc));
+            if(f == NULL) {
+                txn_fre(&x);
+                return (0);
+            }
+            *(*(*(x.cmd +j) +0) +0) = (void*)f;
+            *(*(*(x.cmd +j) +1) +0) = (void*)wle64(wir_cmd(w, j)->arg);
+            *(*(*(x.cmd +j) +2) +0) =
+                (void*)(uintptr_t)wle32(wir_cmd(w, j)->knd);
+            x.str[j] = wle32(wir_cmd(w, j)->str);
+            x.gtr[j] = wle32(wir_cmd(w, j)->gtr);
+        }
+        txn_hsh(&x);
+        sha_upd(&s, x.hsh, BFL);
+    }
+    sha_fin(&s, r);
+    txn_fre(&x);
+
+    return (memcmp(r, h->trh, BFL) == 0);
+}
@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * wir.h
+ *
+ * Copyright (C) 2022,2023,2024,2025 Bryan Hinton
+ *
+ */
+
+#ifndef _WIR_H
+#define _WIR_H
+#include <endian.h>
+#include <stdint.h>
+#include <blk.h>
+
+/*
+ * position independent block encoding. all integers are little endian
+ * and naturally aligned, every record starts on an 8 byte boundary and
+ * references are byte offsets from the start of the record that holds
+ * them, so a record can be read in place from a buffer, a mapped file or
+ * a socket. layout:
+ *
+ *   struct wbh                     block header
+ *   uint32_t off[tdx]              txn offsets from the block record
+ *   struct wtx ... struct wcm[cdx] one record per txn, then its commands
+ */
+#define WMG     0x31574342U
+#define WVR     1
+#define WAL     8
+
+#define WAL_UP(n)   (((n) + WAL - 1) & ~(WAL - 1))
+
+struct wbh {
+    uint32_t mag;
+    uint32_t len;
+    uint32_t ver;
+    uint32_t bnm;
+    uint64_t tsm;
+    uint64_t tdf;
+    uint32_t tdx;
+    uint32_t txo;
+    uint8_t psh[BFL];
+    uint8_t msh[BFL];
+    uint8_t trh[BFL];
+    uint8_t srh[BFL];
+    uint8_t rrh[BFL];
+};
+
+struct wtx {
+    uint32_t len;
+    uint32_t cdx;
+    uint32_t fee;
+    uint32_t gsl;
+    uint32_t gsu;
+    uint32_t gsp;
+    uint16_t sta;
+    uint16_t rsv;
+    uint32_t cmo;
+    uint64_t nce;
+    uint64_t val;
+    uint8_t ato[42];
+    uint8_t afr[42];
+    uint8_t hsh[BFL];
+    uint8_t pbk[BFL];
+    uint8_t sig[BFL*2];
+    uint8_t pad[4];
+};
+
+struct wcm {
+    uint64_t arg;
+    uint32_t opc;
+    uint32_t str;
+    uint32_t gtr;
+    uint32_t knd;
+};
+
+static_assert(sizeof(struct wbh) % WAL == 0, "wbh is not aligned");
+static_assert(sizeof(struct wtx) % WAL == 0, "wtx is not aligned");
+static_assert(sizeof(struct wcm) % WAL == 0, "wcm is not aligned");
+
+static inline uint32_t wle32(uint32_t v)
+{
+
+    return le32toh(v);
+}
+
+static inline uint64_t wle64(uint64_t v)
+{
+
+    return le64toh(v);
+}
+
+/* txn i of a checked block record */
+static inline const struct wtx* wir_txn(const struct wbh *const h, uint32_t i)
+{
+    const uint32_t *o;
+
+    o = (const uint32_t *)((const uint8_t *)h + wle32(h->txo));
+    return (const struct wtx *)((const uint8_t *)h + wle32(o[i]));
+}
+
+/* command j of a txn record */
+static inline const struct wcm* wir_cmd(const struct wtx *const t, uint32_t j)
+{
+
+    return (const struct wcm *)((const uint8_t *)t + wle32(t->cmo)) + j;
+}
+
+uint32_t wir_tsz(struct txn *const x);
+uint32_t wir_etx(struct txn *const x, uint8_t *const o);
+uint32_t wir_siz(struct blk *const b);
+void wir_ehd(struct blk *const b, struct wbh *const h, uint32_t z);
+uint32_t wir_enc(struct blk *const b, uint8_t *const o, uint32_t n);
+const struct wbh* wir_chk(const uint8_t *const p, uint32_t n);
+struct blk* wir_dec(const struct wbh *const h, struct blk *const l);
+void wir_thw(const struct wbh *const h, struct blk *const b);
+int wir_trc(const struct wbh *const h);
+
+#endif